@@ -367,7 +367,7 @@ StmtAST::StmtAST(DataLValIdentAST *lVal_, ExpAST *lOrExp_)
 {
 }
 
-StmtAST::StmtAST(DataLValIdentAST *lVal_, std::vector<int> initvalArray_)
+StmtAST::StmtAST(DataLValIdentAST *lVal_, InitVector initvalArray_)
     : st(StmtEnum::STMT_ASSIGN_ARRAY), lVal(lVal_), ptr(NULL), mainStmt(NULL), elseStmt(NULL),
       initvalArray(initvalArray_)
 {
@@ -423,10 +423,7 @@ void StmtAST::dumpContent(std::ostream &outStream, int indent) const
     case STMT_ASSIGN_ARRAY:
         outStream << Indent(indent + 1) << "STMT_ASSIGN_ARRAY" << std::endl;
         lVal->dump(outStream, indent + 1);
-        outStream << Indent(indent + 1) << "InitvalArray: [";
-        for (int elem : initvalArray)
-            outStream << elem << ", ";
-        outStream << "]" << std::endl;
+        outStream << Indent(indent + 1) << "InitvalArray: " << initvalArray << std::endl;
         break;
     case STMT_EXP:
         outStream << Indent(indent + 1) << "STMT_EXP" << std::endl;
@@ -1084,7 +1081,15 @@ int PrimaryExpAST::forceCalc(SymbolTable *symTab)
     {
         if (!lVal->relaSym)
             lVal->setSymbolTable(symTab);
-        return lVal->relaSym->initval;
+        SymbolEntry *sym = lVal->relaSym;
+        if (!sym->isArray())
+            return sym->initval;
+        /*常量数组的元素，按各维下标取出初值*/
+        assert(lVal->expVec.size() == sym->arrayDimVec.size());
+        int index = 0;
+        for (size_t i = 0; i < lVal->expVec.size(); i++)
+            index = index * sym->arrayDimVec[i] + lVal->expVec[i]->forceCalc(symTab);
+        return sym->initvalArray.at(index);
     }
     assert(true);
     return 0;
@@ -1217,7 +1222,7 @@ void DataDefAST::setSymbolTable(SymbolTable *symTab)
     // arrayDimCum *= e;
 
     int initval_ = 0;
-    std::vector<int> initvalArray_;
+    InitVector initvalArray_;
     bool initInSymTab =
         ((symTab->currentBlockVecIndex.size() == 0) || (defi == DefiEnum::DEFI_CONST));
     bool setStmtAfterSym = (initval != NULL && !initInSymTab);
@@ -1235,7 +1240,7 @@ void DataDefAST::setSymbolTable(SymbolTable *symTab)
         if (initval != NULL)
             initvalArray_ = initval->getInitVector(arrayDimVec_);
         else
-            initvalArray_ = std::vector<int>();
+            initvalArray_ = InitVector();
     }
 
     if (arrayDimVec_.size() == 0 && setStmtAfterSym)
@@ -1252,7 +1257,7 @@ void DataDefAST::setSymbolTable(SymbolTable *symTab)
         for (ExpAST *&exp_ : defIdent->expVec)
             delete exp_;
         defIdent->expVec.clear();
-        std::vector<int> initvalArray__ = initval->getInitVector(arrayDimVec_);
+        InitVector initvalArray__ = initval->getInitVector(arrayDimVec_);
         stmtAfterSym = new StmtAST(defIdent, initvalArray__);
         defIdent = NULL;
     }
@@ -1339,7 +1344,7 @@ void FuncFParamAST::setSymbolTable(SymbolTable *symTab)
     SymbolEntry *sym =
         new SymbolEntry(symTab, para->type, para->defi, symTab->currentFuncName,
                         symTab->currentBlockVecIndex, symTab->currentBlockLineIndex, para->ident,
-                        para->getArrayDim(symTab), 0, std::vector<int>(), true);
+                        para->getArrayDim(symTab), 0, InitVector(), true);
     para->relaSym = sym;
     symTab->append(sym);
 }
@@ -1646,7 +1651,7 @@ const char *DataInitvalAST::getClassName() const { return "DataInitvalAST"; }
 
 void DataInitvalAST::setSymbolTable(SymbolTable *symTab) {}
 
-std::vector<int> DataInitvalAST::getInitVector(std::vector<int> arrayDim, SymbolTable *symTab)
+InitVector DataInitvalAST::getInitVector(std::vector<int> arrayDim, SymbolTable *symTab)
 {
     std::function<int(const std::vector<int> &)> arrayCumFunc =
         [](const std::vector<int> &arrayDim) -> int
@@ -1676,48 +1681,39 @@ std::vector<int> DataInitvalAST::getInitVector(std::vector<int> arrayDim, Symbol
         return nextArrayDim;
     };
 
-    std::function<std::vector<int>(const std::vector<DataInitvalAST *> &, std::vector<int>)>
+    std::function<InitVector(const std::vector<DataInitvalAST *> &, std::vector<int>)>
         dfsFunc = [symTab, &dfsFunc, &getNextEdge,
                    &arrayCumFunc](const std::vector<DataInitvalAST *> &initVec,
-                                  std::vector<int> arrayDim) -> std::vector<int>
+                                  std::vector<int> arrayDim) -> InitVector
     {
         int cum = arrayCumFunc(arrayDim);
-        std::vector<int> retVec;
+        InitVector retVec;
         for (DataInitvalAST *astPtr : initVec)
         {
             if (astPtr->exp)
             {
-                retVec.push_back(astPtr->exp->forceCalc(symTab));
+                retVec.push(astPtr->exp->forceCalc(symTab));
                 continue;
             }
             /*检查当前对齐到了哪个边界*/
             std::vector<int> nextArrayDim = getNextEdge(retVec.size(), arrayDim);
             assert(nextArrayDim.size() != 0);
-            std::vector<int> newVec = dfsFunc(astPtr->initVec, nextArrayDim);
-            for (auto elem : newVec)
-                retVec.push_back(elem);
+            retVec.append(dfsFunc(astPtr->initVec, nextArrayDim));
         }
-        int len = retVec.size();
-        assert(len <= cum);
-        for (int i = len; i < cum; i++)
-            retVec.push_back(0);
+        assert(retVec.size() <= cum);
+        retVec.resize(cum);
         return retVec;
     };
 
-    std::vector<int> retVec;
-
-    int cum = arrayCumFunc(arrayDim);
+    InitVector retVec;
 
     if (this->exp)
-        retVec.push_back(this->exp->forceCalc(symTab));
+        retVec.push(this->exp->forceCalc(symTab));
     else
         retVec = dfsFunc(this->initVec, arrayDim);
 
-    int len = retVec.size();
-    for (int i = len; i < cum; i++)
-        retVec.push_back(0);
-    for (int i = cum; i < len; i++)
-        retVec.pop_back();
+    /*补零或截断到数组大小，零元素不占空间*/
+    retVec.resize(arrayCumFunc(arrayDim));
     return retVec;
 }
 
@@ -2,6 +2,7 @@
 #ifndef _AST_HPP_
 #define _AST_HPP_
 
+#include "initval.hpp"
 #include "keyword.hpp"
 #include <fstream>
 #include <iostream>
@@ -129,11 +130,11 @@ class StmtAST : public BaseAST
     };
     StmtAST *mainStmt;
     StmtAST *elseStmt;
-    std::vector<int> initvalArray;
+    InitVector initvalArray;
     StmtAST();
     StmtAST(StmtEnum st_);
     StmtAST(DataLValIdentAST *lVal_, ExpAST *lOrExp_);
-    StmtAST(DataLValIdentAST *lVal_, std::vector<int> initvalArray_);
+    StmtAST(DataLValIdentAST *lVal_, InitVector initvalArray_);
     StmtAST(StmtEnum st_, ExpAST *lOrExp_);
     StmtAST(BlockAST *block_);
     StmtAST(StmtEnum st_, ExpAST *lOrExp_, StmtAST *mainStmt_, StmtAST *elseStmt_ = NULL);
@@ -315,7 +316,7 @@ class DataInitvalAST : public BaseAST
     virtual void dumpContent(std::ostream &outStream = std::cout, int indent = 0) const override;
     virtual const char *getClassName() const override;
     virtual void setSymbolTable(SymbolTable *symTab) override;
-    std::vector<int> getInitVector(std::vector<int> arrayDim, SymbolTable *symTab = NULL);
+    InitVector getInitVector(std::vector<int> arrayDim, SymbolTable *symTab = NULL);
     virtual void buildIR(IRBuilder *irBuilder, SymbolTable *symTab) override;
 };
 
@@ -0,0 +1,86 @@
+#include "initval.hpp"
+#include <algorithm>
+#include <cassert>
+
+/* InitRun */
+
+InitRun::InitRun(int offset_) : offset(offset_), valueVec() {}
+
+int InitRun::end() const { return offset + (int)valueVec.size(); }
+
+/* InitVector */
+
+InitVector::InitVector(int length_) : length(length_), runVec() {}
+
+int InitVector::size() const { return length; }
+
+int InitVector::at(int index) const
+{
+    assert(index >= 0 && index < length);
+    auto iter = std::upper_bound(runVec.begin(), runVec.end(), index,
+                                 [](int index, const InitRun &run) { return index < run.offset; });
+    if (iter == runVec.begin())
+        return 0;
+    iter--;
+    return index < iter->end() ? iter->valueVec[index - iter->offset] : 0;
+}
+
+bool InitVector::isZero(int begin, int end) const
+{
+    /*找到第一个结束于 begin 之后的段*/
+    auto iter = std::upper_bound(runVec.begin(), runVec.end(), begin,
+                                 [](int begin, const InitRun &run) { return begin < run.end(); });
+    return iter == runVec.end() || iter->offset >= end;
+}
+
+void InitVector::push(int value)
+{
+    if (value != 0)
+    {
+        if (runVec.empty() || runVec.back().end() != length)
+            runVec.push_back(InitRun(length));
+        runVec.back().valueVec.push_back(value);
+    }
+    length++;
+}
+
+void InitVector::append(const InitVector &vec)
+{
+    for (const InitRun &run : vec.runVec)
+    {
+        if (runVec.empty() || runVec.back().end() != length + run.offset)
+            runVec.push_back(InitRun(length + run.offset));
+        std::vector<int> &valueVec = runVec.back().valueVec;
+        valueVec.insert(valueVec.end(), run.valueVec.begin(), run.valueVec.end());
+    }
+    length += vec.length;
+}
+
+void InitVector::resize(int length_)
+{
+    while (!runVec.empty() && runVec.back().offset >= length_)
+        runVec.pop_back();
+    if (!runVec.empty() && runVec.back().end() > length_)
+        runVec.back().valueVec.resize(length_ - runVec.back().offset);
+    length = length_;
+}
+
+void InitVector::dump(std::ostream &outStream) const
+{
+    outStream << "[";
+    for (const InitRun &run : runVec)
+    {
+        outStream << run.offset << ": ";
+        for (int elem : run.valueVec)
+            outStream << elem << ", ";
+    }
+    outStream << "length: " << length << "]";
+}
+
+std::ostream &operator<<(std::ostream &outStream, const InitVector &vec)
+{
+    vec.dump(outStream);
+    return outStream;
+}
+
+/* END */
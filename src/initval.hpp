@@ -0,0 +1,37 @@
+#ifndef _INITVAL_HPP_
+#define _INITVAL_HPP_
+
+#include <iostream>
+#include <vector>
+
+class InitRun;
+class InitVector;
+
+/*一段连续的非零初值*/
+class InitRun
+{
+  public:
+    int offset;
+    std::vector<int> valueVec;
+    InitRun(int offset_ = 0);
+    int end() const;
+};
+
+/*稀疏的数组初值，只记录非零元素组成的段，段按偏移递增且互不相邻*/
+class InitVector
+{
+  public:
+    int length;
+    std::vector<InitRun> runVec;
+    InitVector(int length_ = 0);
+    int size() const;
+    int at(int index) const;
+    bool isZero(int begin, int end) const;
+    void push(int value);
+    void append(const InitVector &vec);
+    void resize(int length_);
+    void dump(std::ostream &outStream = std::cout) const;
+    friend std::ostream &operator<<(std::ostream &outStream, const InitVector &vec);
+};
+
+#endif // !_INITVAL_HPP_
@@ -58,8 +58,10 @@ std::ostream &operator<<(std::ostream &outStream, const IRFunction &func)
 
 IRBuilder::IRBuilder()
     : currentVarCounter(0), currentBlockCounter(0), currentBlock(NULL),
-      funcName(), blockVec(), dataVec(), funcVec()
+      funcName(), blockVec(), declVec(), dataVec(), funcVec()
 {
+    for (auto p = libFuncDecl; (*p)[0]; p++)
+        declVec.push_back(std::string("decl @") + (*p)[0] + '(' + (*p)[1] + ')' + (*p)[2]);
 }
 
 void IRBuilder::buildFrom(CompUnitAST *ast, SymbolTable *symTab)
@@ -71,8 +73,8 @@ void IRBuilder::buildFrom(CompUnitAST *ast, SymbolTable *symTab)
 
 void IRBuilder::dump(std::ostream &outStream) const
 {
-    for (auto p = libFuncDecl; (*p)[0]; p++)
-        outStream << "decl @" << (*p)[0] << '(' << (*p)[1] << ')' << (*p)[2] << std::endl;
+    for (const std::string &decl : declVec)
+        outStream << decl << std::endl;
     outStream << std::endl;
     for (const std::string &data : dataVec)
         outStream << data << std::endl;
@@ -208,27 +210,45 @@ std::string IRBuilder::getIRType(const std::vector<int> &arrayDim_)
     return typeName;
 }
 
-std::string IRBuilder::aggregate1DtoNDString(const std::vector<int> &initvalVec,
+std::string IRBuilder::aggregate1DtoNDString(const InitVector &initvalVec,
                                              const std::vector<int> &arrayDim)
 {
-    if (initvalVec.size() == 0)
+    if (initvalVec.isZero(0, initvalVec.size()))
         return std::string("zeroinit");
 
-    std::vector<int>::const_iterator valIter = initvalVec.begin(), dimIter = arrayDim.begin(),
-                                     dimIterEnd = arrayDim.end();
+    /*strideVec[i] 为第 i 维每个元素包含的整数个数*/
+    int dimCount = arrayDim.size();
+    std::vector<int> strideVec(dimCount + 1, 1);
+    for (int i = dimCount - 1; i >= 0; i--)
+        strideVec[i] = strideVec[i + 1] * arrayDim[i];
 
-    std::function<std::string(std::vector<int>::const_iterator)> factorial =
-        [&factorial, &valIter, &dimIterEnd](std::vector<int>::const_iterator dimIter) -> std::string
+    std::string retString;
+    std::function<void(int, int)> factorial =
+        [&factorial, &retString, &initvalVec, &arrayDim, &strideVec, dimCount](int dim, int begin)
     {
-        if (dimIter == dimIterEnd)
-            return std::to_string(*(valIter++));
-        std::string retString = "{";
-        for (int i = 0; i < *dimIter; i++)
-            retString += std::string(i ? ", " : "") + factorial(dimIter + 1);
+        if (dim == dimCount)
+        {
+            retString += std::to_string(initvalVec.at(begin));
+            return;
+        }
+        /*全零的子数组直接写为 zeroinit。Koopa 的聚合初值没有稀疏写法，含非零元素的一维只能逐个列出，
+          int a[1000000] = {1} 在 IR 中仍是稠密的一行，到汇编时才把连续的零合并为 .zero*/
+        if (dim != 0 && initvalVec.isZero(begin, begin + strideVec[dim]))
+        {
+            retString += "zeroinit";
+            return;
+        }
+        retString += "{";
+        for (int i = 0; i < arrayDim[dim]; i++)
+        {
+            if (i)
+                retString += ", ";
+            factorial(dim + 1, begin + i * strideVec[dim + 1]);
+        }
         retString += "}";
-        return retString;
     };
-    return factorial(dimIter);
+    factorial(0, 0);
+    return retString;
 }
 
 std::ostream &operator<<(std::ostream &outStream, const IRBuilder &build)
@@ -56,6 +56,7 @@ class IRBuilder
     std::string whileTestBlockName;
     std::string whileEndBlockName;
 
+    std::vector<std::string> declVec;
     std::vector<std::string> dataVec;
     std::vector<IRFunction *> funcVec;
 
@@ -82,7 +83,7 @@ class IRBuilder
     void dump(std::ostream &outStream) const;
     friend std::ostream &operator<<(std::ostream &outStream, const IRBuilder &block);
     std::string getIRType(const std::vector<int> &arrayDim_ = std::vector<int>());
-    std::string aggregate1DtoNDString(const std::vector<int> &initvalVec,
+    std::string aggregate1DtoNDString(const InitVector &initvalVec,
                                       const std::vector<int> &arrayDim);
 };
 
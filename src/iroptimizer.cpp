@@ -0,0 +1,1038 @@
+#include "iroptimizer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <functional>
+
+/* IRInst */
+
+IRInst::IRInst() : dest(), op(), type(), callee(), args(), labels(), labelArgs() {}
+
+IRInst::IRInst(std::string dest_, std::string op_, std::vector<std::string> args_)
+    : dest(dest_), op(op_), type(), callee(), args(args_), labels(), labelArgs()
+{
+}
+
+std::vector<std::string> IRInst::splitOperands(const std::string &str)
+{
+    std::vector<std::string> vec;
+    std::string current;
+    int depth = 0;
+    for (char c : str)
+    {
+        if (c == '(' || c == '[' || c == '{')
+            depth++;
+        if (c == ')' || c == ']' || c == '}')
+            depth--;
+        if (c == ',' && depth == 0)
+        {
+            vec.push_back(current);
+            current.clear();
+            continue;
+        }
+        if (c == ' ' && current.empty())
+            continue;
+        current.push_back(c);
+    }
+    while (!current.empty() && current.back() == ' ')
+        current.pop_back();
+    if (!current.empty() || !vec.empty())
+        vec.push_back(current);
+    return vec;
+}
+
+IRInst IRInst::parse(const std::string &stmt)
+{
+    IRInst inst;
+    std::string rest = stmt;
+
+    /* global @x = alloc T, init */
+    if (rest.compare(0, 7, "global ") == 0)
+    {
+        size_t eq = rest.find(" = alloc ");
+        inst.dest = rest.substr(7, eq - 7);
+        inst.op = std::string("global");
+        std::vector<std::string> vec = splitOperands(rest.substr(eq + 9));
+        assert(vec.size() == 2);
+        inst.type = vec[0];
+        inst.args.push_back(vec[1]);
+        return inst;
+    }
+
+    size_t eq = rest.find(" = ");
+    if ((rest[0] == '%' || rest[0] == '@') && eq != std::string::npos)
+    {
+        inst.dest = rest.substr(0, eq);
+        rest = rest.substr(eq + 3);
+    }
+    size_t space = rest.find(' ');
+    inst.op = rest.substr(0, space);
+    rest = (space == std::string::npos) ? std::string() : rest.substr(space + 1);
+
+    auto parseLabel = [&inst](const std::string &label)
+    {
+        size_t paren = label.find('(');
+        inst.labels.push_back(label.substr(0, paren));
+        if (paren == std::string::npos)
+            inst.labelArgs.push_back(std::vector<std::string>());
+        else
+            inst.labelArgs.push_back(
+                splitOperands(label.substr(paren + 1, label.size() - paren - 2)));
+    };
+
+    if (inst.op == "alloc")
+        inst.type = rest;
+    else if (inst.op == "call")
+    {
+        size_t paren = rest.find('(');
+        inst.callee = rest.substr(0, paren);
+        inst.args = splitOperands(rest.substr(paren + 1, rest.size() - paren - 2));
+    }
+    else if (inst.op == "br")
+    {
+        std::vector<std::string> vec = splitOperands(rest);
+        assert(vec.size() == 3);
+        inst.args.push_back(vec[0]);
+        parseLabel(vec[1]);
+        parseLabel(vec[2]);
+    }
+    else if (inst.op == "jump")
+        parseLabel(rest);
+    else if (inst.op == "ret")
+    {
+        if (!rest.empty())
+            inst.args.push_back(rest);
+    }
+    else
+        inst.args = splitOperands(rest);
+    return inst;
+}
+
+bool IRInst::isConst(const std::string &value)
+{
+    if (value.empty())
+        return false;
+    size_t start = (value[0] == '-') ? 1 : 0;
+    if (start == value.size())
+        return false;
+    for (size_t i = start; i < value.size(); i++)
+        if (value[i] < '0' || value[i] > '9')
+            return false;
+    return true;
+}
+
+int IRInst::constValue(const std::string &value)
+{
+    assert(isConst(value));
+    return (int)strtoll(value.c_str(), NULL, 10);
+}
+
+int IRInst::typeSize(const std::string &type)
+{
+    if (type[0] != '[')
+        return 1;
+    size_t comma = type.rfind(',');
+    return typeSize(elemType(type)) * constValue(type.substr(comma + 2, type.size() - comma - 3));
+}
+
+std::string IRInst::elemType(const std::string &type)
+{
+    if (type[0] == '*')
+        return type.substr(1);
+    assert(type[0] == '[');
+    return type.substr(1, type.rfind(',') - 1);
+}
+
+std::vector<std::string> IRInst::flattenInit(const std::string &init, const std::string &type)
+{
+    if (init == "zeroinit")
+        return std::vector<std::string>(typeSize(type), std::string("0"));
+    if (type[0] != '[')
+        return std::vector<std::string>(1, init);
+    std::vector<std::string> vec;
+    for (const std::string &elem : splitOperands(init.substr(1, init.size() - 2)))
+    {
+        std::vector<std::string> elemVec = flattenInit(elem, elemType(type));
+        vec.insert(vec.end(), elemVec.begin(), elemVec.end());
+    }
+    return vec;
+}
+
+std::string IRInst::initElement(const std::string &init, const std::string &type, int index)
+{
+    /*只展开下标所在的那一层，不必展开整个初值*/
+    if (init == "zeroinit")
+        return std::string("0");
+    if (type[0] != '[')
+        return init;
+    std::string elem = elemType(type);
+    int size = typeSize(elem);
+    std::vector<std::string> elemVec = splitOperands(init.substr(1, init.size() - 2));
+    return initElement(elemVec[index / size], elem, index % size);
+}
+
+bool IRInst::isTerminator() const { return op == "br" || op == "jump" || op == "ret"; }
+
+bool IRInst::isBinary() const
+{
+    static const char *binaryOp[] = {"ne",  "eq",  "gt",  "lt", "ge", "le",  "add", "sub", "mul",
+                                     "div", "mod", "and", "or", "xor", "shl", "shr", "sar", NULL};
+    for (const char **p = binaryOp; *p; p++)
+        if (op == *p)
+            return true;
+    return false;
+}
+
+bool IRInst::hasSideEffect() const
+{
+    return op == "store" || op == "call" || op == "br" || op == "jump" || op == "ret";
+}
+
+std::vector<std::string *> IRInst::useRefs()
+{
+    std::vector<std::string *> vec;
+    if (op == "alloc" || op == "global")
+        return vec;
+    for (std::string &arg : args)
+        vec.push_back(&arg);
+    for (std::vector<std::string> &argVec : labelArgs)
+        for (std::string &arg : argVec)
+            vec.push_back(&arg);
+    return vec;
+}
+
+std::vector<std::string> IRInst::uses() const
+{
+    std::vector<std::string> vec;
+    for (std::string *ref : const_cast<IRInst *>(this)->useRefs())
+        vec.push_back(*ref);
+    return vec;
+}
+
+std::string IRInst::toString() const
+{
+    auto join = [](const std::vector<std::string> &vec) -> std::string
+    {
+        std::string res;
+        for (size_t i = 0; i < vec.size(); i++)
+            res += std::string(i ? ", " : "") + vec[i];
+        return res;
+    };
+    auto label = [this, &join](size_t i) -> std::string
+    {
+        if (labelArgs[i].empty())
+            return labels[i];
+        return labels[i] + "(" + join(labelArgs[i]) + ")";
+    };
+
+    if (op == "global")
+        return std::string("global ") + dest + " = alloc " + type + ", " + args[0];
+
+    std::string res = dest.empty() ? std::string() : dest + " = ";
+    if (op == "alloc")
+        res += "alloc " + type;
+    else if (op == "call")
+        res += "call " + callee + "(" + join(args) + ")";
+    else if (op == "br")
+        res += "br " + args[0] + ", " + label(0) + ", " + label(1);
+    else if (op == "jump")
+        res += "jump " + label(0);
+    else if (op == "ret")
+        res += args.empty() ? std::string("ret") : "ret " + args[0];
+    else
+        res += op + " " + join(args);
+    return res;
+}
+
+std::ostream &operator<<(std::ostream &outStream, const IRInst &inst)
+{
+    outStream << inst.toString();
+    return outStream;
+}
+
+/* OptBlock */
+
+OptBlock::OptBlock()
+    : blockName(), paramVec(), instVec(), predVec(), succVec(), idom(NULL), domChildVec(), domDepth(0),
+      loop(NULL)
+{
+}
+
+OptBlock::OptBlock(std::string blockName_)
+    : blockName(blockName_), paramVec(), instVec(), predVec(), succVec(), idom(NULL), domChildVec(),
+      domDepth(0), loop(NULL)
+{
+}
+
+IRInst &OptBlock::terminator()
+{
+    assert(!instVec.empty() && instVec.back().isTerminator());
+    return instVec.back();
+}
+
+int OptBlock::loopDepth() const { return loop ? loop->depth : 0; }
+
+std::string OptBlock::getLabel() const
+{
+    if (paramVec.empty())
+        return blockName;
+    std::string label = blockName + "(";
+    for (size_t i = 0; i < paramVec.size(); i++)
+        label += std::string(i ? ", " : "") + paramVec[i].first + ": " + paramVec[i].second;
+    return label + ")";
+}
+
+/* OptLoop */
+
+OptLoop::OptLoop() : header(NULL), blockVec(), blockSet(), parent(NULL), childVec(), depth(0) {}
+
+OptLoop::OptLoop(OptBlock *header_)
+    : header(header_), blockVec(), blockSet(), parent(NULL), childVec(), depth(0)
+{
+}
+
+bool OptLoop::contains(OptBlock *block) const { return blockSet.count(block) != 0; }
+
+std::vector<OptBlock *> OptLoop::getLatches() const
+{
+    std::vector<OptBlock *> vec;
+    for (OptBlock *pred : header->predVec)
+        if (contains(pred) && std::find(vec.begin(), vec.end(), pred) == vec.end())
+            vec.push_back(pred);
+    return vec;
+}
+
+std::vector<OptBlock *> OptLoop::getExitBlocks() const
+{
+    std::vector<OptBlock *> vec;
+    for (OptBlock *block : blockVec)
+        for (OptBlock *succ : block->succVec)
+            if (!contains(succ) && std::find(vec.begin(), vec.end(), succ) == vec.end())
+                vec.push_back(succ);
+    return vec;
+}
+
+/* OptFunction */
+
+OptFunction::OptFunction()
+    : funcName(), outputType(), paramVec(), blockVec(), loopVec(), varCounter(0), blockCounter(0)
+{
+}
+
+OptFunction::OptFunction(const IRFunction *irFunc)
+    : funcName(irFunc->funcName), outputType(irFunc->outputType), paramVec(), blockVec(),
+      loopVec(), varCounter(0), blockCounter(0)
+{
+    for (const std::string &param : IRInst::splitOperands(irFunc->inputType))
+    {
+        size_t colon = param.find(": ");
+        paramVec.push_back(std::make_pair(param.substr(0, colon), param.substr(colon + 2)));
+    }
+
+    /*与 IRFunction::dump 一致，跳过死代码块和空块*/
+    for (IRBlock *irBlock : irFunc->blockVec)
+    {
+        if (irBlock->deadBlock || irBlock->stmtVec.size() == 0)
+            continue;
+        size_t paren = irBlock->blockName.find('(');
+        OptBlock *block = new OptBlock(irBlock->blockName.substr(0, paren));
+        if (paren != std::string::npos)
+        {
+            std::string params = irBlock->blockName.substr(paren + 1);
+            params.pop_back();
+            for (const std::string &param : IRInst::splitOperands(params))
+            {
+                size_t colon = param.find(": ");
+                block->paramVec.push_back(
+                    std::make_pair(param.substr(0, colon), param.substr(colon + 2)));
+            }
+        }
+        for (const std::string &stmt : irBlock->stmtVec)
+            block->instVec.push_back(IRInst::parse(stmt));
+        blockVec.push_back(block);
+    }
+
+    /*新的变量名和块名接着 IRBuilder 的编号*/
+    auto updateCounter = [](const std::string &name, const std::string &prefix, int &counter)
+    {
+        if (name.compare(0, prefix.size(), prefix) != 0)
+            return;
+        std::string number = name.substr(prefix.size());
+        if (IRInst::isConst(number))
+            counter = std::max(counter, IRInst::constValue(number) + 1);
+    };
+    for (OptBlock *block : blockVec)
+    {
+        updateCounter(block->blockName, "%BLOCK", blockCounter);
+        for (IRInst &inst : block->instVec)
+            updateCounter(inst.dest, "%VAR", varCounter);
+    }
+}
+
+OptFunction::OptFunction(const OptFunction &func, std::string funcName_)
+    : funcName(funcName_), outputType(func.outputType), paramVec(func.paramVec), blockVec(),
+      loopVec(), varCounter(func.varCounter), blockCounter(func.blockCounter)
+{
+    for (OptBlock *block : func.blockVec)
+    {
+        OptBlock *newBlock = new OptBlock(block->blockName);
+        newBlock->paramVec = block->paramVec;
+        newBlock->instVec = block->instVec;
+        blockVec.push_back(newBlock);
+    }
+    buildCFG();
+}
+
+OptFunction::~OptFunction()
+{
+    for (OptBlock *block : blockVec)
+        delete block;
+    for (OptLoop *loop : loopVec)
+        delete loop;
+}
+
+std::string OptFunction::getInputType() const
+{
+    std::string inputType;
+    for (size_t i = 0; i < paramVec.size(); i++)
+        inputType += std::string(i ? ", " : "") + paramVec[i].first + ": " + paramVec[i].second;
+    return inputType;
+}
+
+IRFunction *OptFunction::toIRFunction() const
+{
+    std::vector<IRBlock *> irBlockVec;
+    for (OptBlock *block : blockVec)
+    {
+        IRBlock *irBlock = new IRBlock(block->getLabel());
+        for (const IRInst &inst : block->instVec)
+            irBlock->stmtVec.push_back(inst.toString());
+        irBlockVec.push_back(irBlock);
+    }
+    return new IRFunction(funcName, getInputType(), outputType, irBlockVec);
+}
+
+std::string OptFunction::getNextVarIdent() { return "%VAR" + std::to_string(varCounter++); }
+
+std::string OptFunction::getNextBlockIdent() { return "%BLOCK" + std::to_string(blockCounter++); }
+
+OptBlock *OptFunction::findBlock(const std::string &name) const
+{
+    for (OptBlock *block : blockVec)
+        if (block->blockName == name)
+            return block;
+    return NULL;
+}
+
+void OptFunction::buildCFG()
+{
+    std::map<std::string, OptBlock *> blockMap;
+    for (OptBlock *block : blockVec)
+    {
+        blockMap[block->blockName] = block;
+        block->predVec.clear();
+        block->succVec.clear();
+    }
+    for (OptBlock *block : blockVec)
+    {
+        for (const std::string &label : block->terminator().labels)
+        {
+            assert(blockMap.count(label));
+            OptBlock *succ = blockMap[label];
+            block->succVec.push_back(succ);
+            succ->predVec.push_back(block);
+        }
+    }
+
+    /*删除不可达的基本块*/
+    std::set<OptBlock *> visited;
+    std::vector<OptBlock *> stack(1, blockVec.front());
+    visited.insert(blockVec.front());
+    while (!stack.empty())
+    {
+        OptBlock *block = stack.back();
+        stack.pop_back();
+        for (OptBlock *succ : block->succVec)
+            if (visited.insert(succ).second)
+                stack.push_back(succ);
+    }
+    if (visited.size() == blockVec.size())
+        return;
+
+    /*先从可达后继的前驱中去掉死块，全部处理完再释放，死块之间可能互相指向*/
+    std::vector<OptBlock *> liveVec, deadVec;
+    for (OptBlock *block : blockVec)
+    {
+        if (visited.count(block))
+        {
+            liveVec.push_back(block);
+            continue;
+        }
+        deadVec.push_back(block);
+        for (OptBlock *succ : block->succVec)
+        {
+            if (!visited.count(succ))
+                continue;
+            auto &predVec = succ->predVec;
+            predVec.erase(std::remove(predVec.begin(), predVec.end(), block), predVec.end());
+        }
+    }
+    for (OptBlock *block : deadVec)
+        delete block;
+    blockVec = liveVec;
+}
+
+std::vector<OptBlock *> OptFunction::getRPO() const
+{
+    std::vector<OptBlock *> postVec;
+    std::set<OptBlock *> visited;
+    std::vector<std::pair<OptBlock *, size_t>> stack;
+    stack.push_back(std::make_pair(blockVec.front(), 0));
+    visited.insert(blockVec.front());
+    while (!stack.empty())
+    {
+        OptBlock *block = stack.back().first;
+        size_t &next = stack.back().second;
+        if (next < block->succVec.size())
+        {
+            OptBlock *succ = block->succVec[next++];
+            if (visited.insert(succ).second)
+                stack.push_back(std::make_pair(succ, 0));
+            continue;
+        }
+        postVec.push_back(block);
+        stack.pop_back();
+    }
+    return std::vector<OptBlock *>(postVec.rbegin(), postVec.rend());
+}
+
+void OptFunction::buildDomTree()
+{
+    /*Cooper-Harvey-Kennedy 迭代算法*/
+    std::vector<OptBlock *> rpo = getRPO();
+    std::map<OptBlock *, int> order;
+    for (size_t i = 0; i < rpo.size(); i++)
+        order[rpo[i]] = (int)i;
+    for (OptBlock *block : blockVec)
+    {
+        block->idom = NULL;
+        block->domChildVec.clear();
+    }
+    OptBlock *entry = blockVec.front();
+    entry->idom = entry;
+
+    auto intersect = [&order](OptBlock *a, OptBlock *b) -> OptBlock *
+    {
+        while (a != b)
+        {
+            while (order[a] > order[b])
+                a = a->idom;
+            while (order[b] > order[a])
+                b = b->idom;
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (OptBlock *block : rpo)
+        {
+            if (block == entry)
+                continue;
+            OptBlock *newIdom = NULL;
+            for (OptBlock *pred : block->predVec)
+                if (pred->idom)
+                    newIdom = newIdom ? intersect(pred, newIdom) : pred;
+            if (newIdom != block->idom)
+            {
+                block->idom = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    for (OptBlock *block : rpo)
+    {
+        if (block == entry)
+        {
+            block->domDepth = 0;
+            continue;
+        }
+        block->domDepth = block->idom->domDepth + 1;
+        block->idom->domChildVec.push_back(block);
+    }
+    entry->idom = NULL;
+}
+
+std::map<OptBlock *, OptBlock *> OptFunction::getPostIdom() const
+{
+    /*在反向图上求支配树，所有 ret 块汇到虚拟出口（记为 NULL）*/
+    std::vector<OptBlock *> postVec;
+    std::set<OptBlock *> visited;
+    std::vector<std::pair<OptBlock *, size_t>> stack;
+    for (OptBlock *root : blockVec)
+    {
+        if (!root->succVec.empty() || !visited.insert(root).second)
+            continue;
+        stack.push_back(std::make_pair(root, 0));
+        while (!stack.empty())
+        {
+            OptBlock *block = stack.back().first;
+            size_t &next = stack.back().second;
+            if (next < block->predVec.size())
+            {
+                OptBlock *pred = block->predVec[next++];
+                if (visited.insert(pred).second)
+                    stack.push_back(std::make_pair(pred, 0));
+                continue;
+            }
+            postVec.push_back(block);
+            stack.pop_back();
+        }
+    }
+
+    std::map<OptBlock *, int> order;
+    for (size_t i = 0; i < postVec.size(); i++)
+        order[postVec[i]] = (int)(postVec.size() - i);
+    order[NULL] = 0;
+    std::map<OptBlock *, OptBlock *> ipdom;
+    std::set<OptBlock *> doneSet;
+    auto intersect = [&order, &ipdom](OptBlock *a, OptBlock *b) -> OptBlock *
+    {
+        while (a != b)
+        {
+            while (order[a] > order[b])
+                a = ipdom[a];
+            while (order[b] > order[a])
+                b = ipdom[b];
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto iter = postVec.rbegin(); iter != postVec.rend(); iter++)
+        {
+            OptBlock *block = *iter;
+            bool found = block->succVec.empty();
+            OptBlock *newIdom = NULL;
+            for (OptBlock *succ : block->succVec)
+            {
+                if (!doneSet.count(succ))
+                    continue;
+                newIdom = found ? intersect(succ, newIdom) : succ;
+                found = true;
+            }
+            if (!found)
+                continue;
+            if (!doneSet.count(block) || ipdom[block] != newIdom)
+            {
+                ipdom[block] = newIdom;
+                doneSet.insert(block);
+                changed = true;
+            }
+        }
+    }
+    return ipdom;
+}
+
+bool OptFunction::dominates(OptBlock *a, OptBlock *b) const
+{
+    while (b && b->domDepth > a->domDepth)
+        b = b->idom;
+    return a == b;
+}
+
+void OptFunction::buildLoops()
+{
+    for (OptLoop *loop : loopVec)
+        delete loop;
+    loopVec.clear();
+    for (OptBlock *block : blockVec)
+        block->loop = NULL;
+
+    /*回边 pred -> header，header 支配 pred*/
+    std::vector<OptBlock *> rpo = getRPO();
+    for (OptBlock *header : rpo)
+    {
+        OptLoop *loop = NULL;
+        for (OptBlock *pred : header->predVec)
+        {
+            if (!dominates(header, pred))
+                continue;
+            if (!loop)
+            {
+                loop = new OptLoop(header);
+                loop->blockSet.insert(header);
+            }
+            std::vector<OptBlock *> stack;
+            if (loop->blockSet.insert(pred).second)
+                stack.push_back(pred);
+            while (!stack.empty())
+            {
+                OptBlock *block = stack.back();
+                stack.pop_back();
+                for (OptBlock *p : block->predVec)
+                    if (loop->blockSet.insert(p).second)
+                        stack.push_back(p);
+            }
+        }
+        if (loop)
+            loopVec.push_back(loop);
+    }
+
+    for (OptLoop *loop : loopVec)
+        for (OptBlock *block : blockVec)
+            if (loop->contains(block))
+                loop->blockVec.push_back(block);
+
+    /*嵌套关系：父循环是包含它的最小循环*/
+    for (OptLoop *loop : loopVec)
+    {
+        for (OptLoop *other : loopVec)
+        {
+            if (other == loop || !other->contains(loop->header) ||
+                other->blockSet.size() <= loop->blockSet.size())
+                continue;
+            if (!loop->parent || other->blockSet.size() < loop->parent->blockSet.size())
+                loop->parent = other;
+        }
+    }
+    std::function<int(OptLoop *)> getDepth = [&getDepth](OptLoop *loop) -> int
+    { return loop->parent ? getDepth(loop->parent) + 1 : 1; };
+    for (OptLoop *loop : loopVec)
+    {
+        loop->depth = getDepth(loop);
+        if (loop->parent)
+            loop->parent->childVec.push_back(loop);
+    }
+    std::stable_sort(loopVec.begin(), loopVec.end(),
+                     [](OptLoop *a, OptLoop *b) { return a->depth < b->depth; });
+
+    for (OptLoop *loop : loopVec)
+        for (OptBlock *block : loop->blockVec)
+            block->loop = loop;
+}
+
+void OptFunction::buildAnalysis()
+{
+    buildCFG();
+    buildDomTree();
+    buildLoops();
+}
+
+void OptFunction::replaceAllUses(const std::string &from, const std::string &to)
+{
+    for (OptBlock *block : blockVec)
+        for (IRInst &inst : block->instVec)
+            for (std::string *ref : inst.useRefs())
+                if (*ref == from)
+                    *ref = to;
+}
+
+std::map<std::string, int> OptFunction::countUses()
+{
+    std::map<std::string, int> useCount;
+    for (OptBlock *block : blockVec)
+        for (IRInst &inst : block->instVec)
+            for (std::string *ref : inst.useRefs())
+                useCount[*ref]++;
+    return useCount;
+}
+
+int OptFunction::instCount() const
+{
+    int count = 0;
+    for (OptBlock *block : blockVec)
+        count += block->instVec.size();
+    return count;
+}
+
+bool OptFunction::isLocalAlloc(const std::string &value) const
+{
+    for (OptBlock *block : blockVec)
+        for (const IRInst &inst : block->instVec)
+            if (inst.op == "alloc" && inst.dest == value)
+                return true;
+    return false;
+}
+
+OptBlock *OptFunction::getPreheader(OptLoop *loop)
+{
+    OptBlock *header = loop->header;
+    std::vector<OptBlock *> outsideVec;
+    for (OptBlock *pred : header->predVec)
+        if (!loop->contains(pred) &&
+            std::find(outsideVec.begin(), outsideVec.end(), pred) == outsideVec.end())
+            outsideVec.push_back(pred);
+    if (outsideVec.size() == 1 && outsideVec[0]->succVec.size() == 1)
+        return outsideVec[0];
+
+    /*新建前置块，循环外的前驱都改为跳到它，块参数原样转发*/
+    OptBlock *preheader = new OptBlock(getNextBlockIdent());
+    IRInst jumpInst(std::string(), std::string("jump"));
+    jumpInst.labels.push_back(header->blockName);
+    jumpInst.labelArgs.push_back(std::vector<std::string>());
+    for (auto &param : header->paramVec)
+    {
+        std::string name = getNextVarIdent();
+        preheader->paramVec.push_back(std::make_pair(name, param.second));
+        jumpInst.labelArgs[0].push_back(name);
+    }
+    preheader->instVec.push_back(jumpInst);
+    for (OptBlock *pred : outsideVec)
+    {
+        IRInst &term = pred->terminator();
+        for (std::string &label : term.labels)
+            if (label == header->blockName)
+                label = preheader->blockName;
+    }
+    blockVec.insert(std::find(blockVec.begin(), blockVec.end(), header), preheader);
+    buildAnalysis();
+    return preheader;
+}
+
+OptBlock *OptFunction::splitEdge(OptBlock *pred, size_t labelIndex)
+{
+    IRInst &term = pred->terminator();
+    OptBlock *block = new OptBlock(getNextBlockIdent());
+    IRInst jumpInst(std::string(), std::string("jump"));
+    jumpInst.labels.push_back(term.labels[labelIndex]);
+    jumpInst.labelArgs.push_back(term.labelArgs[labelIndex]);
+    block->instVec.push_back(jumpInst);
+    OptBlock *succ = findBlock(term.labels[labelIndex]);
+    term.labels[labelIndex] = block->blockName;
+    term.labelArgs[labelIndex].clear();
+    blockVec.insert(std::find(blockVec.begin(), blockVec.end(), succ), block);
+    return block;
+}
+
+void OptFunction::removeBlockParam(OptBlock *block, size_t index)
+{
+    block->paramVec.erase(block->paramVec.begin() + index);
+    for (OptBlock *pred : block->predVec)
+    {
+        IRInst &term = pred->terminator();
+        for (size_t i = 0; i < term.labels.size(); i++)
+            if (term.labels[i] == block->blockName &&
+                term.labelArgs[i].size() > block->paramVec.size())
+                term.labelArgs[i].erase(term.labelArgs[i].begin() + index);
+    }
+}
+
+void OptFunction::dump(std::ostream &outStream) const
+{
+    IRFunction *irFunc = toIRFunction();
+    outStream << *irFunc;
+    for (IRBlock *block : irFunc->blockVec)
+        delete block;
+    delete irFunc;
+}
+
+/* IROptimizer */
+
+IROptimizer::IROptimizer() : declVec(), globalVec(), funcVec() {}
+
+IROptimizer::~IROptimizer()
+{
+    for (OptFunction *func : funcVec)
+        delete func;
+}
+
+void IROptimizer::loadFrom(IRBuilder *irBuilder)
+{
+    declVec = irBuilder->declVec;
+    for (const std::string &data : irBuilder->dataVec)
+        globalVec.push_back(IRInst::parse(data));
+    for (IRFunction *irFunc : irBuilder->funcVec)
+    {
+        OptFunction *func = new OptFunction(irFunc);
+        func->buildCFG();
+        funcVec.push_back(func);
+    }
+}
+
+void IROptimizer::storeTo(IRBuilder *irBuilder)
+{
+    irBuilder->declVec = declVec;
+    irBuilder->dataVec.clear();
+    for (const IRInst &global : globalVec)
+        irBuilder->dataVec.push_back(global.toString());
+    for (IRFunction *irFunc : irBuilder->funcVec)
+    {
+        for (IRBlock *block : irFunc->blockVec)
+            delete block;
+        delete irFunc;
+    }
+    irBuilder->funcVec.clear();
+    for (OptFunction *func : funcVec)
+        irBuilder->funcVec.push_back(func->toIRFunction());
+}
+
+OptFunction *IROptimizer::findFunc(const std::string &name) const
+{
+    for (OptFunction *func : funcVec)
+        if ("@" + func->funcName == name)
+            return func;
+    return NULL;
+}
+
+bool IROptimizer::isSymbolUsed(const std::string &name) const
+{
+    if (findFunc(name))
+        return true;
+    for (const IRInst &global : globalVec)
+        if (global.dest == name)
+            return true;
+    for (const std::string &decl : declVec)
+        if (decl.compare(5, name.size() + 1, name + "(") == 0)
+            return true;
+    return false;
+}
+
+bool IROptimizer::requireBuiltin(const std::string &name)
+{
+    /*内建函数与用户的符号重名时不能使用*/
+    for (auto p = builtinFuncDecl; (*p)[0]; p++)
+    {
+        if (name != std::string("@") + (*p)[0])
+            continue;
+        std::string decl = std::string("decl ") + name + '(' + (*p)[1] + ')' + (*p)[2];
+        if (std::find(declVec.begin(), declVec.end(), decl) != declVec.end())
+            return true;
+        if (isSymbolUsed(name))
+            return false;
+        declVec.push_back(decl);
+        return true;
+    }
+    assert(false);
+    return false;
+}
+
+void IROptimizer::optimize(IRBuilder *irBuilder)
+{
+    loadFrom(irBuilder);
+    eliminateDeadSymbol();
+
+    localizeGlobal();
+    buildModRef();
+    for (OptFunction *func : funcVec)
+        promoteGlobal(func);
+
+    propagateConst();
+    if (specializeFunc())
+        propagateConst();
+
+    bool scalarChanged = false;
+    for (OptFunction *func : funcVec)
+    {
+        scalarChanged |= threadJump(func);
+        scalarChanged |= simplifyRange(func);
+    }
+    if (scalarChanged)
+        propagateConst();
+
+    bool loopChanged = false;
+    for (OptFunction *func : funcVec)
+        loopChanged |= recognizeIdiom(func);
+    if (loopChanged)
+        propagateConst();
+
+    loopChanged = false;
+    for (OptFunction *func : funcVec)
+        loopChanged |= evaluateLoopExit(func);
+    if (loopChanged)
+        propagateConst();
+
+    loopChanged = false;
+    for (OptFunction *func : funcVec)
+    {
+        loopChanged |= interchangeLoop(func);
+        loopChanged |= tileLoop(func);
+        loopChanged |= fuseLoop(func);
+        loopChanged |= unswitchLoop(func);
+    }
+    if (loopChanged)
+        propagateConst();
+
+    /*先完全展开小循环并化简，再对剩下的内层循环做部分展开*/
+    for (bool partial : {false, true})
+    {
+        loopChanged = false;
+        for (OptFunction *func : funcVec)
+            loopChanged |= unrollLoop(func, partial);
+        if (loopChanged)
+            propagateConst();
+    }
+
+    scalarChanged = false;
+    for (OptFunction *func : funcVec)
+    {
+        scalarChanged |= eliminatePartialRedundancy(func);
+        scalarChanged |= simplifyRange(func);
+    }
+    if (scalarChanged)
+        propagateConst();
+
+    /*最后把小分支改写为无分支的选择，嵌套的分支在化简合并后逐层处理*/
+    bool converted = true;
+    while (converted)
+    {
+        converted = false;
+        for (OptFunction *func : funcVec)
+            converted |= convertIf(func);
+        if (converted)
+            propagateConst();
+    }
+
+    /*if 转换把分支中的计算提前之后，再消除一次冗余，最后全局调度纯指令*/
+    scalarChanged = false;
+    for (OptFunction *func : funcVec)
+        scalarChanged |= eliminatePartialRedundancy(func);
+    if (scalarChanged)
+        propagateConst();
+    for (OptFunction *func : funcVec)
+        moveGlobalCode(func);
+
+    eliminateDeadSymbol();
+
+    storeTo(irBuilder);
+}
+
+bool IROptimizer::propagateConst()
+{
+    static const int maxIteration = 16;
+
+    bool everChanged = false;
+    for (int i = 0; i < maxIteration; i++)
+    {
+        bool changed = propagateArgConst();
+        buildModRef();
+        for (OptFunction *func : funcVec)
+        {
+            bool funcChanged = true;
+            while (funcChanged)
+            {
+                funcChanged = splitLocalArray(func);
+                funcChanged |= promoteAlloc(func);
+                funcChanged |= simplifyBlockParam(func);
+                funcChanged |= forwardMemory(func);
+                funcChanged |= eliminateDeadStore(func);
+                funcChanged |= foldConstant(func);
+                funcChanged |= combineInst(func);
+                funcChanged |= simplifyCFG(func);
+                funcChanged |= eliminateDeadCode(func);
+                changed |= funcChanged;
+            }
+        }
+        everChanged |= changed;
+        if (!changed)
+            break;
+    }
+    return everChanged;
+}
+
+/* END */
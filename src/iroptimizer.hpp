@@ -0,0 +1,247 @@
+#ifndef _IROPTIMIZER_HPP_
+#define _IROPTIMIZER_HPP_
+
+#include "irbuilder.hpp"
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class IRInst;
+class OptBlock;
+class OptLoop;
+class OptFunction;
+class IROptimizer;
+
+class IRInst
+{
+  public:
+    std::string dest;                                /*定义的值，没有则为空*/
+    std::string op;                                  /*指令名，全局变量为 global*/
+    std::string type;                                /*alloc 的类型*/
+    std::string callee;                              /*call 的函数名*/
+    std::vector<std::string> args;                   /*操作数*/
+    std::vector<std::string> labels;                 /*br/jump 的目标基本块*/
+    std::vector<std::vector<std::string>> labelArgs; /*目标基本块的参数*/
+    IRInst();
+    IRInst(std::string dest_, std::string op_,
+           std::vector<std::string> args_ = std::vector<std::string>());
+    static IRInst parse(const std::string &stmt);
+    static std::vector<std::string> splitOperands(const std::string &str);
+    static bool isConst(const std::string &value);
+    static int constValue(const std::string &value);
+    static int typeSize(const std::string &type);
+    static std::string elemType(const std::string &type);
+    static std::vector<std::string> flattenInit(const std::string &init, const std::string &type);
+    static std::string initElement(const std::string &init, const std::string &type, int index);
+    static bool evalBinary(const std::string &op, int lhs, int rhs, int &res);
+    bool isTerminator() const;
+    bool isBinary() const;
+    bool hasSideEffect() const;
+    std::vector<std::string *> useRefs();
+    std::vector<std::string> uses() const;
+    std::string toString() const;
+    friend std::ostream &operator<<(std::ostream &outStream, const IRInst &inst);
+};
+
+class OptBlock
+{
+  public:
+    std::string blockName;
+    std::vector<std::pair<std::string, std::string>> paramVec; /*基本块参数 (参数名, 类型)*/
+    std::vector<IRInst> instVec;
+    std::vector<OptBlock *> predVec;
+    std::vector<OptBlock *> succVec;
+    OptBlock *idom;
+    std::vector<OptBlock *> domChildVec;
+    int domDepth;
+    OptLoop *loop; /*所在的最内层循环*/
+    OptBlock();
+    OptBlock(std::string blockName_);
+    IRInst &terminator();
+    int loopDepth() const;
+    std::string getLabel() const;
+};
+
+class OptLoop
+{
+  public:
+    OptBlock *header;
+    std::vector<OptBlock *> blockVec; /*按函数中的顺序*/
+    std::set<OptBlock *> blockSet;
+    OptLoop *parent;
+    std::vector<OptLoop *> childVec;
+    int depth;
+    OptLoop();
+    OptLoop(OptBlock *header_);
+    bool contains(OptBlock *block) const;
+    std::vector<OptBlock *> getLatches() const;
+    std::vector<OptBlock *> getExitBlocks() const;
+};
+
+class OptFunction
+{
+  public:
+    std::string funcName;
+    std::string outputType;
+    std::vector<std::pair<std::string, std::string>> paramVec; /*(参数名, 类型)*/
+    std::vector<OptBlock *> blockVec;                          /*blockVec[0] 为入口*/
+    std::vector<OptLoop *> loopVec;                            /*外层循环在前*/
+    int varCounter;
+    int blockCounter;
+    OptFunction();
+    OptFunction(const IRFunction *irFunc);
+    OptFunction(const OptFunction &func, std::string funcName_);
+    ~OptFunction();
+    IRFunction *toIRFunction() const;
+    std::string getInputType() const;
+    std::string getNextVarIdent();
+    std::string getNextBlockIdent();
+    OptBlock *findBlock(const std::string &name) const;
+    void buildCFG();
+    void buildDomTree();
+    void buildLoops();
+    void buildAnalysis();
+    bool dominates(OptBlock *a, OptBlock *b) const;
+    std::vector<OptBlock *> getRPO() const;
+    std::map<OptBlock *, OptBlock *> getPostIdom() const;
+    void replaceAllUses(const std::string &from, const std::string &to);
+    std::map<std::string, int> countUses();
+    int instCount() const;
+    bool isLocalAlloc(const std::string &value) const;
+    OptBlock *getPreheader(OptLoop *loop);
+    OptBlock *splitEdge(OptBlock *pred, size_t labelIndex);
+    void removeBlockParam(OptBlock *block, size_t index);
+    void dump(std::ostream &outStream = std::cout) const;
+};
+
+class OptAlias
+{
+  public:
+    enum AliasResult
+    {
+        NO_ALIAS,
+        MAY_ALIAS,
+        MUST_ALIAS
+    };
+    enum RootKind
+    {
+        ROOT_ALLOC,   /*局部变量*/
+        ROOT_GLOBAL,  /*全局变量*/
+        ROOT_PARAM,   /*指针参数指向调用者的内存*/
+        ROOT_UNKNOWN, /*来源不明的指针*/
+    };
+    class MemLocation
+    {
+      public:
+        std::string root;
+        RootKind kind;
+        int offset;                         /*常数偏移，单位为 4 字节*/
+        std::map<std::string, int> termMap; /*变量偏移：变量 -> 系数*/
+    };
+
+    OptFunction *func;
+    IROptimizer *optimizer;
+    std::map<std::string, std::string> typeMap;
+    std::map<std::string, IRInst> defMap;
+    std::set<std::string> escapedSet; /*地址被传出的局部变量*/
+    std::map<std::string, MemLocation> locMap;
+
+    OptAlias(OptFunction *func_, IROptimizer *optimizer_);
+    const MemLocation &locate(const std::string &ptr);
+    AliasResult alias(const std::string &p, const std::string &q, bool wholeObject = false);
+    bool callMayTouch(const IRInst &call, const std::string &ptr, bool write);
+    bool isPointer(const std::string &value) const;
+
+  private:
+    void linearize(const std::string &value, int scale, MemLocation &loc, int depth);
+};
+
+/*区间值域分析，区间由常数、循环边界和支配分支上的比较推出*/
+class OptRange
+{
+  public:
+    class Interval
+    {
+      public:
+        long long lo; /*lo > hi 表示空区间，即尚未求出*/
+        long long hi;
+    };
+
+    OptFunction *func;
+    std::map<std::string, IRInst *> defMap;
+    std::map<std::string, Interval> rangeMap; /*值在定义处的区间*/
+
+    OptRange(OptFunction *func_);
+    Interval getRange(const std::string &value, OptBlock *block);
+    bool decide(const std::string &cond, OptBlock *block, bool &result);
+
+  private:
+    Interval paramRange(OptBlock *block, size_t index);
+    Interval evalInst(const IRInst &inst, OptBlock *block);
+    void refine(const std::string &value, const std::string &cond, bool taken, Interval &range,
+                int depth);
+};
+
+class IROptimizer
+{
+  public:
+    std::vector<std::string> declVec;
+    std::vector<IRInst> globalVec;
+    std::vector<OptFunction *> funcVec;
+    std::map<std::string, std::set<std::string>> funcModMap; /*函数可能写的全局变量，* 为指针参数*/
+    std::map<std::string, std::set<std::string>> funcRefMap; /*函数可能读的全局变量，* 为指针参数*/
+    std::set<std::string> readOnlySet;                        /*整个程序中只读的全局变量*/
+
+    IROptimizer();
+    ~IROptimizer();
+    void optimize(IRBuilder *irBuilder);
+    void loadFrom(IRBuilder *irBuilder);
+    void storeTo(IRBuilder *irBuilder);
+    OptFunction *findFunc(const std::string &name) const;
+    bool isSymbolUsed(const std::string &name) const;
+    bool requireBuiltin(const std::string &name);
+    static bool libCallTouch(const std::string &callee, size_t index, bool write);
+
+    /* 过程间 */
+    bool propagateArgConst();
+    bool specializeFunc();
+    void removeFuncParam(OptFunction *func, int index, const std::string &value);
+    bool eliminateDeadSymbol();
+    void buildModRef();
+
+    /* 访存 */
+    bool localizeGlobal();
+    bool promoteGlobal(OptFunction *func);
+    bool promoteAlloc(OptFunction *func);
+    bool splitLocalArray(OptFunction *func);
+    bool forwardMemory(OptFunction *func);
+    bool eliminateDeadStore(OptFunction *func);
+
+    /* 过程内 */
+    bool propagateConst();
+    bool foldConstant(OptFunction *func);
+    bool combineInst(OptFunction *func);
+    bool simplifyCFG(OptFunction *func);
+    bool simplifyBlockParam(OptFunction *func);
+    bool threadJump(OptFunction *func);
+    bool simplifyRange(OptFunction *func);
+    bool convertIf(OptFunction *func);
+    bool eliminateDeadCode(OptFunction *func);
+
+    /* 代码移动 */
+    bool eliminatePartialRedundancy(OptFunction *func);
+    bool moveGlobalCode(OptFunction *func);
+
+    /* 循环 */
+    bool recognizeIdiom(OptFunction *func);
+    bool evaluateLoopExit(OptFunction *func);
+    bool interchangeLoop(OptFunction *func);
+    bool tileLoop(OptFunction *func);
+    bool fuseLoop(OptFunction *func);
+    bool unswitchLoop(OptFunction *func);
+    bool unrollLoop(OptFunction *func, bool partial);
+};
+
+#endif // !_IROPTIMIZER_HPP_
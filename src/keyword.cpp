@@ -23,6 +23,12 @@ const char *libFuncDecl[][3] = {
     {"putint", "i32", ""},   {"putch", "i32", ""},   {"putarray", "i32, *i32", ""},
     {"starttime", "", ""},   {"stoptime", "", ""},   {NULL, NULL, NULL}};
 
+/*优化时按需引入、由后端直接生成汇编的内建函数*/
+const char *builtinFuncDecl[][3] = {{"__sysy_fill", "*i32, i32, i32", ""},
+                                    {"__sysy_copy", "*i32, *i32, i32", ""},
+                                    {"__sysy_sum", "*i32, i32", ": i32"},
+                                    {NULL, NULL, NULL}};
+
 const char *riscvInst[] = {
     
     // OP_NONE,
@@ -2,6 +2,7 @@
 #include "ast.hpp"
 #include "define.hpp"
 #include "irbuilder.hpp"
+#include "iroptimizer.hpp"
 #include "koopa.h"
 #include "koopaparser.hpp"
 #include "riscvbuilder.hpp"
@@ -24,6 +25,12 @@ int main(int argc, const char *argv[])
     IRBuilder *irBuilder = new IRBuilder();
     irBuilder->buildFrom(ast, symTab);
 
+    if (args.isPerf())
+    {
+        IROptimizer *irOptimizer = new IROptimizer();
+        irOptimizer->optimize(irBuilder);
+    }
+
     if (args.toKoopa())
     {
         args.ostream() << *irBuilder << std::endl;
@@ -0,0 +1,194 @@
+#include "iroptimizer.hpp"
+#include <cassert>
+
+OptAlias::OptAlias(OptFunction *func_, IROptimizer *optimizer_)
+    : func(func_), optimizer(optimizer_), typeMap(), defMap(), escapedSet(), locMap()
+{
+    for (const IRInst &global : optimizer->globalVec)
+        typeMap[global.dest] = "*" + global.type;
+    for (auto &param : func->paramVec)
+        typeMap[param.first] = param.second;
+    for (OptBlock *block : func->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            typeMap[param.first] = param.second;
+        for (IRInst &inst : block->instVec)
+            if (!inst.dest.empty())
+                defMap[inst.dest] = inst;
+    }
+
+    /*按支配顺序推导值的类型*/
+    for (OptBlock *block : func->getRPO())
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.dest.empty())
+                continue;
+            bool pointerOp = inst.op == "getelemptr" || inst.op == "getptr" || inst.op == "load";
+            if (pointerOp && !typeMap.count(inst.args[0]))
+                continue;
+            if (inst.op == "alloc")
+                typeMap[inst.dest] = "*" + inst.type;
+            else if (inst.op == "getelemptr")
+                typeMap[inst.dest] = "*" + IRInst::elemType(IRInst::elemType(typeMap[inst.args[0]]));
+            else if (inst.op == "getptr")
+                typeMap[inst.dest] = typeMap[inst.args[0]];
+            else if (inst.op == "load")
+                typeMap[inst.dest] = IRInst::elemType(typeMap[inst.args[0]]);
+            else
+                typeMap[inst.dest] = std::string("i32");
+        }
+    }
+
+    /*地址作为值被使用的局部变量视为逃逸*/
+    for (OptBlock *block : func->blockVec)
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            std::vector<std::string> valueVec;
+            if (inst.op == "call" || inst.op == "ret")
+                valueVec = inst.args;
+            else if (inst.op == "store")
+                valueVec.push_back(inst.args[0]);
+            for (const std::vector<std::string> &argVec : inst.labelArgs)
+                valueVec.insert(valueVec.end(), argVec.begin(), argVec.end());
+            for (const std::string &value : valueVec)
+            {
+                if (!isPointer(value))
+                    continue;
+                const MemLocation &loc = locate(value);
+                if (loc.kind == ROOT_ALLOC)
+                    escapedSet.insert(loc.root);
+            }
+        }
+    }
+}
+
+bool OptAlias::isPointer(const std::string &value) const
+{
+    auto iter = typeMap.find(value);
+    return iter != typeMap.end() && iter->second[0] == '*';
+}
+
+void OptAlias::linearize(const std::string &value, int scale, MemLocation &loc, int depth)
+{
+    static const int maxDepth = 4;
+    if (IRInst::isConst(value))
+    {
+        loc.offset += IRInst::constValue(value) * scale;
+        return;
+    }
+    auto iter = defMap.find(value);
+    if (depth < maxDepth && iter != defMap.end())
+    {
+        const IRInst &inst = iter->second;
+        if (inst.op == "add" || inst.op == "sub")
+        {
+            linearize(inst.args[0], scale, loc, depth + 1);
+            linearize(inst.args[1], inst.op == "add" ? scale : -scale, loc, depth + 1);
+            return;
+        }
+        if (inst.op == "mul" && IRInst::isConst(inst.args[1]))
+        {
+            linearize(inst.args[0], scale * IRInst::constValue(inst.args[1]), loc, depth + 1);
+            return;
+        }
+        if (inst.op == "mul" && IRInst::isConst(inst.args[0]))
+        {
+            linearize(inst.args[1], scale * IRInst::constValue(inst.args[0]), loc, depth + 1);
+            return;
+        }
+    }
+    if ((loc.termMap[value] += scale) == 0)
+        loc.termMap.erase(value);
+}
+
+const OptAlias::MemLocation &OptAlias::locate(const std::string &ptr)
+{
+    auto iter = locMap.find(ptr);
+    if (iter != locMap.end())
+        return iter->second;
+
+    MemLocation loc;
+    loc.root = ptr;
+    loc.kind = ROOT_UNKNOWN;
+    loc.offset = 0;
+    auto def = defMap.find(ptr);
+    if (def != defMap.end() && def->second.op == "alloc")
+        loc.kind = ROOT_ALLOC;
+    else if (def != defMap.end() &&
+             (def->second.op == "getelemptr" || def->second.op == "getptr"))
+    {
+        const IRInst &inst = def->second;
+        std::string srcType = typeMap[inst.args[0]];
+        int stride = IRInst::typeSize(IRInst::elemType(srcType));
+        if (inst.op == "getelemptr")
+            stride = IRInst::typeSize(IRInst::elemType(IRInst::elemType(srcType)));
+        loc = locate(inst.args[0]);
+        linearize(inst.args[1], stride, loc, 0);
+    }
+    else if (def == defMap.end())
+    {
+        for (const IRInst &global : optimizer->globalVec)
+            if (global.dest == ptr)
+                loc.kind = ROOT_GLOBAL;
+        for (auto &param : func->paramVec)
+            if (param.first == ptr)
+                loc.kind = ROOT_PARAM;
+    }
+    return locMap[ptr] = loc;
+}
+
+OptAlias::AliasResult OptAlias::alias(const std::string &p, const std::string &q, bool wholeObject)
+{
+    if (p == q && !wholeObject)
+        return MUST_ALIAS;
+    const MemLocation a = locate(p);
+    const MemLocation b = locate(q);
+    if (a.root == b.root)
+    {
+        if (wholeObject || a.termMap != b.termMap)
+            return MAY_ALIAS;
+        return a.offset == b.offset ? MUST_ALIAS : NO_ALIAS;
+    }
+
+    auto isObject = [](RootKind kind) { return kind == ROOT_ALLOC || kind == ROOT_GLOBAL; };
+    if (isObject(a.kind) && isObject(b.kind))
+        return NO_ALIAS;
+    /*未逃逸的局部变量只能通过自己访问，参数也不可能指向本次调用的局部变量*/
+    if ((a.kind == ROOT_ALLOC && (!escapedSet.count(a.root) || b.kind == ROOT_PARAM)) ||
+        (b.kind == ROOT_ALLOC && (!escapedSet.count(b.root) || a.kind == ROOT_PARAM)))
+        return NO_ALIAS;
+    return MAY_ALIAS;
+}
+
+bool OptAlias::callMayTouch(const IRInst &call, const std::string &ptr, bool write)
+{
+    assert(call.op == "call");
+    const MemLocation loc = locate(ptr);
+    if (loc.kind == ROOT_ALLOC && !escapedSet.count(loc.root))
+        return false;
+    if (!optimizer->findFunc(call.callee))
+    {
+        for (size_t i = 0; i < call.args.size(); i++)
+            if (IROptimizer::libCallTouch(call.callee, i, write) &&
+                alias(call.args[i], ptr, true) != NO_ALIAS)
+                return true;
+        return false;
+    }
+
+    std::set<std::string> &touchSet =
+        write ? optimizer->funcModMap[call.callee] : optimizer->funcRefMap[call.callee];
+    if (loc.kind != ROOT_GLOBAL)
+        return !touchSet.empty();
+    if (touchSet.count(loc.root))
+        return true;
+    if (!touchSet.count("*"))
+        return false;
+    for (const std::string &arg : call.args)
+        if (isPointer(arg) && alias(arg, ptr, true) != NO_ALIAS)
+            return true;
+    return false;
+}
+
+/* END */
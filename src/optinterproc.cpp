@@ -0,0 +1,184 @@
+#include "iroptimizer.hpp"
+#include <algorithm>
+
+void IROptimizer::removeFuncParam(OptFunction *func, int index, const std::string &value)
+{
+    func->replaceAllUses(func->paramVec[index].first, value);
+    func->paramVec.erase(func->paramVec.begin() + index);
+    for (OptFunction *caller : funcVec)
+        for (OptBlock *block : caller->blockVec)
+            for (IRInst &inst : block->instVec)
+                if (inst.op == "call" && inst.callee == "@" + func->funcName)
+                    inst.args.erase(inst.args.begin() + index);
+}
+
+bool IROptimizer::propagateArgConst()
+{
+    /*所有调用点都传入同一常数的参数，直接替换为常数并从参数表中删除*/
+    bool changed = false;
+    for (OptFunction *func : funcVec)
+    {
+        if (func->funcName == "main")
+            continue;
+        std::vector<IRInst *> callVec;
+        for (OptFunction *caller : funcVec)
+            for (OptBlock *block : caller->blockVec)
+                for (IRInst &inst : block->instVec)
+                    if (inst.op == "call" && inst.callee == "@" + func->funcName)
+                        callVec.push_back(&inst);
+        if (callVec.empty())
+            continue;
+
+        for (int i = (int)func->paramVec.size() - 1; i >= 0; i--)
+        {
+            if (func->paramVec[i].second != "i32")
+                continue;
+            const std::string value = callVec[0]->args[i];
+            if (!IRInst::isConst(value))
+                continue;
+            bool same = true;
+            for (IRInst *call : callVec)
+                same &= (call->args[i] == value);
+            if (!same)
+                continue;
+            removeFuncParam(func, i, value);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool IROptimizer::specializeFunc()
+{
+    /*循环内带常数实参的调用，为被调函数生成去掉这些参数的特化版本*/
+    static const int maxFuncSize = 200;
+    static const int maxTotalSize = 1000;
+    static const int maxSpecPerFunc = 4;
+
+    bool changed = false;
+    int budget = maxTotalSize;
+    std::map<std::string, std::string> specMap; /*被调函数和常数实参 -> 特化函数名*/
+    std::map<OptFunction *, int> specCount;
+
+    std::vector<OptFunction *> callerVec = funcVec;
+    for (OptFunction *caller : callerVec)
+    {
+        caller->buildAnalysis();
+        for (OptBlock *block : caller->blockVec)
+        {
+            if (block->loopDepth() == 0)
+                continue;
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.op != "call")
+                    continue;
+                OptFunction *callee = findFunc(inst.callee);
+                if (!callee || callee == caller)
+                    continue;
+
+                std::vector<int> constIndex;
+                std::string key = inst.callee;
+                for (size_t i = 0; i < inst.args.size(); i++)
+                {
+                    if (callee->paramVec[i].second != "i32" || !IRInst::isConst(inst.args[i]))
+                        continue;
+                    constIndex.push_back(i);
+                    key += " " + std::to_string(i) + ":" + inst.args[i];
+                }
+                if (constIndex.empty())
+                    continue;
+
+                /*只有含分支的函数才有可能因常数实参而化简*/
+                bool hasBranch = false;
+                for (OptBlock *calleeBlock : callee->blockVec)
+                    hasBranch |= (calleeBlock->terminator().op == "br");
+                int size = callee->instCount();
+                if (!hasBranch || size > maxFuncSize)
+                    continue;
+
+                if (!specMap.count(key))
+                {
+                    if (specCount[callee] >= maxSpecPerFunc || size > budget)
+                        continue;
+                    std::string specName;
+                    for (int n = 0; specName.empty() || isSymbolUsed("@" + specName); n++)
+                        specName = callee->funcName + "_spec" + std::to_string(n);
+                    OptFunction *spec = new OptFunction(*callee, specName);
+                    for (auto iter = constIndex.rbegin(); iter != constIndex.rend(); iter++)
+                    {
+                        spec->replaceAllUses(spec->paramVec[*iter].first, inst.args[*iter]);
+                        spec->paramVec.erase(spec->paramVec.begin() + *iter);
+                    }
+                    /*函数需先定义后使用，特化版本紧跟在原函数之后*/
+                    funcVec.insert(std::find(funcVec.begin(), funcVec.end(), callee) + 1, spec);
+                    specMap[key] = specName;
+                    specCount[callee]++;
+                    budget -= size;
+                }
+
+                inst.callee = "@" + specMap[key];
+                for (auto iter = constIndex.rbegin(); iter != constIndex.rend(); iter++)
+                    inst.args.erase(inst.args.begin() + *iter);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+bool IROptimizer::eliminateDeadSymbol()
+{
+    /*从 main 出发，沿调用和全局变量引用求可达的符号*/
+    std::set<std::string> liveSet;
+    std::vector<OptFunction *> stack;
+    liveSet.insert("@main");
+    stack.push_back(findFunc("@main"));
+    while (!stack.empty())
+    {
+        OptFunction *func = stack.back();
+        stack.pop_back();
+        for (OptBlock *block : func->blockVec)
+        {
+            for (IRInst &inst : block->instVec)
+            {
+                std::vector<std::string> refVec = inst.uses();
+                if (inst.op == "call")
+                    refVec.push_back(inst.callee);
+                for (const std::string &ref : refVec)
+                {
+                    if (ref[0] != '@' || !liveSet.insert(ref).second)
+                        continue;
+                    OptFunction *callee = findFunc(ref);
+                    if (callee)
+                        stack.push_back(callee);
+                }
+            }
+        }
+    }
+
+    size_t count = declVec.size() + globalVec.size() + funcVec.size();
+    std::vector<std::string> liveDeclVec;
+    for (const std::string &decl : declVec)
+        if (liveSet.count(decl.substr(5, decl.find('(') - 5)))
+            liveDeclVec.push_back(decl);
+    declVec = liveDeclVec;
+
+    std::vector<IRInst> liveGlobalVec;
+    for (const IRInst &global : globalVec)
+        if (liveSet.count(global.dest))
+            liveGlobalVec.push_back(global);
+    globalVec = liveGlobalVec;
+
+    std::vector<OptFunction *> liveFuncVec;
+    for (OptFunction *func : funcVec)
+    {
+        if (liveSet.count("@" + func->funcName))
+            liveFuncVec.push_back(func);
+        else
+            delete func;
+    }
+    funcVec = liveFuncVec;
+    return declVec.size() + globalVec.size() + funcVec.size() != count;
+}
+
+/* END */
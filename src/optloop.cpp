@@ -0,0 +1,1933 @@
+#include "iroptimizer.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+/*只从头部退出、只有一个回边的循环（innermost 时须为最内层），头部参数 iv 每次加常数 step，
+  头部比较 iv 和循环不变的 bound，结果为真时进入循环体*/
+struct LoopShape
+{
+    OptBlock *latch;
+    int ivIndex;
+    int cmpIndex;
+    bool ivFirst;
+    std::string bound;
+    int step;
+};
+
+static bool analyzeLoop(OptFunction *func, OptLoop *loop, LoopShape &shape, bool innermost = true)
+{
+    OptBlock *header = loop->header;
+    std::vector<OptBlock *> latchVec = loop->getLatches();
+    if ((innermost && !loop->childVec.empty()) || loop->blockVec.size() < 2 || latchVec.size() != 1)
+        return false;
+    shape.latch = latchVec[0];
+    for (OptBlock *block : loop->blockVec)
+        for (OptBlock *succ : block->succVec)
+            if (block != header && !loop->contains(succ))
+                return false;
+
+    std::set<std::string> loopDefSet;
+    std::map<std::string, IRInst *> defMap;
+    for (OptBlock *block : loop->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            loopDefSet.insert(param.first);
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.dest.empty())
+                continue;
+            loopDefSet.insert(inst.dest);
+            defMap[inst.dest] = &inst;
+        }
+    }
+
+    IRInst &br = header->terminator();
+    IRInst &jump = shape.latch->terminator();
+    if (br.op != "br" || br.labels[0] == header->blockName || jump.op != "jump" ||
+        !loop->contains(func->findBlock(br.labels[0])) ||
+        loop->contains(func->findBlock(br.labels[1])))
+        return false;
+
+    shape.cmpIndex = -1;
+    for (size_t i = 0; i < header->instVec.size(); i++)
+        if (header->instVec[i].dest == br.args[0])
+            shape.cmpIndex = i;
+    if (shape.cmpIndex < 0)
+        return false;
+    IRInst &cmp = header->instVec[shape.cmpIndex];
+    if (cmp.op != "lt" && cmp.op != "le" && cmp.op != "gt" && cmp.op != "ge" && cmp.op != "ne")
+        return false;
+
+    shape.ivIndex = -1;
+    for (size_t j = 0; j < header->paramVec.size(); j++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            if (cmp.args[k] != header->paramVec[j].first || loopDefSet.count(cmp.args[1 - k]))
+                continue;
+            shape.ivIndex = j;
+            shape.ivFirst = (k == 0);
+            shape.bound = cmp.args[1 - k];
+        }
+    }
+    if (shape.ivIndex < 0)
+        return false;
+
+    /*回边传入的值为 iv 加减常数*/
+    const std::string &iv = header->paramVec[shape.ivIndex].first;
+    const std::string &next = jump.labelArgs[0][shape.ivIndex];
+    if (!defMap.count(next))
+        return false;
+    IRInst &stepInst = *defMap[next];
+    if (stepInst.op == "add" && stepInst.args[0] == iv && IRInst::isConst(stepInst.args[1]))
+        shape.step = IRInst::constValue(stepInst.args[1]);
+    else if (stepInst.op == "add" && stepInst.args[1] == iv && IRInst::isConst(stepInst.args[0]))
+        shape.step = IRInst::constValue(stepInst.args[0]);
+    else if (stepInst.op == "sub" && stepInst.args[0] == iv && IRInst::isConst(stepInst.args[1]))
+        shape.step = -IRInst::constValue(stepInst.args[1]);
+    else
+        return false;
+    return shape.step != 0 && shape.step > -(1 << 16) && shape.step < (1 << 16);
+}
+
+bool IROptimizer::recognizeIdiom(OptFunction *func)
+{
+    /*只有条件判断和一个循环体的最内层循环，识别逐个填充、复制和求和，改为调用内建函数*/
+    bool changed = false;
+    func->buildAnalysis();
+    OptAlias alias(func, this);
+    std::vector<OptLoop *> loopVec = func->loopVec;
+    for (OptLoop *loop : loopVec)
+    {
+        if (!loop->childVec.empty() || loop->blockVec.size() != 2)
+            continue;
+        OptBlock *header = loop->header;
+        OptBlock *body = (loop->blockVec[0] == header) ? loop->blockVec[1] : loop->blockVec[0];
+        if (header->instVec.size() != 2 || body->predVec.size() != 1)
+            continue;
+        IRInst &cmp = header->instVec[0];
+        IRInst &br = header->instVec[1];
+        IRInst &jump = body->terminator();
+        if (br.op != "br" || br.args[0] != cmp.dest || br.labels[0] != body->blockName ||
+            !br.labelArgs[0].empty() || br.labels[1] == header->blockName || jump.op != "jump")
+            continue;
+
+        std::set<std::string> loopDefSet;
+        for (auto &param : header->paramVec)
+            loopDefSet.insert(param.first);
+        for (OptBlock *block : loop->blockVec)
+            for (IRInst &inst : block->instVec)
+                if (!inst.dest.empty())
+                    loopDefSet.insert(inst.dest);
+        auto isInvariant = [&loopDefSet](const std::string &value)
+        { return !loopDefSet.count(value); };
+
+        /*归纳变量从初值每次加一，直到不小于循环不变的上界*/
+        if (cmp.op != "lt" && cmp.op != "le" && cmp.op != "gt" && cmp.op != "ge")
+            continue;
+        bool swapped = (cmp.op == "gt" || cmp.op == "ge");
+        std::string iv = cmp.args[swapped ? 1 : 0], bound = cmp.args[swapped ? 0 : 1];
+        bool inclusive = (cmp.op == "le" || cmp.op == "ge");
+        int ivIndex = -1;
+        for (size_t j = 0; j < header->paramVec.size(); j++)
+            if (header->paramVec[j].first == iv)
+                ivIndex = j;
+        if (ivIndex < 0 || !isInvariant(bound))
+            continue;
+
+        IRInst *storeInst = NULL, *loadInst = NULL, *stepInst = NULL, *accInst = NULL;
+        bool valid = true;
+        for (IRInst &inst : body->instVec)
+        {
+            bool isStep = inst.op == "add" && inst.dest == jump.labelArgs[0][ivIndex] &&
+                          ((inst.args[0] == iv && inst.args[1] == "1") ||
+                           (inst.args[1] == iv && inst.args[0] == "1"));
+            if (inst.op == "store")
+            {
+                valid &= (storeInst == NULL);
+                storeInst = &inst;
+            }
+            else if (inst.op == "load")
+            {
+                valid &= (loadInst == NULL);
+                loadInst = &inst;
+            }
+            else if (isStep)
+                stepInst = &inst;
+            else if (!inst.isTerminator() && !inst.isBinary() && inst.op != "getelemptr" &&
+                     inst.op != "getptr")
+                valid = false;
+        }
+        if (!valid || !stepInst)
+            continue;
+
+        /*除归纳变量外至多一个块参数，只能是累加载入值的求和变量*/
+        std::string acc;
+        for (size_t j = 0; j < header->paramVec.size() && valid; j++)
+        {
+            if ((int)j == ivIndex)
+                continue;
+            valid = acc.empty() && loadInst;
+            acc = header->paramVec[j].first;
+            for (IRInst &inst : body->instVec)
+                if (inst.dest == jump.labelArgs[0][j])
+                    accInst = &inst;
+            valid = valid && accInst && accInst->op == "add" &&
+                    ((accInst->args[0] == acc && accInst->args[1] == loadInst->dest) ||
+                     (accInst->args[1] == acc && accInst->args[0] == loadInst->dest));
+        }
+        if (!valid)
+            continue;
+
+        /*循环中定义的值不能在循环外使用*/
+        std::map<std::string, int> useCount = func->countUses();
+        std::map<std::string, int> bodyUseCount;
+        for (IRInst &inst : body->instVec)
+            for (const std::string &value : inst.uses())
+                bodyUseCount[value]++;
+        if (useCount[iv] != bodyUseCount[iv] + 1 || useCount[stepInst->dest] != 1)
+            continue;
+        if (accInst && (useCount[accInst->dest] != 1 || bodyUseCount[acc] != 1))
+            continue;
+        if (loadInst && useCount[loadInst->dest] != 1)
+            continue;
+
+        /*访问的地址相对归纳变量步长为一个字，其余部分循环不变*/
+        auto isUnitStride = [&alias, &isInvariant, &iv](const std::string &ptr) -> bool
+        {
+            const OptAlias::MemLocation &loc = alias.locate(ptr);
+            if (!isInvariant(loc.root) || !loc.termMap.count(iv) || loc.termMap.at(iv) != 1)
+                return false;
+            for (auto &term : loc.termMap)
+                if (term.first != iv && !isInvariant(term.first))
+                    return false;
+            return true;
+        };
+
+        std::string builtin;
+        std::vector<std::string> argVec;
+        if (storeInst && !loadInst && isInvariant(storeInst->args[0]) &&
+            isUnitStride(storeInst->args[1]))
+        {
+            builtin = "@__sysy_fill";
+            argVec = {storeInst->args[1], storeInst->args[0]};
+        }
+        else if (storeInst && loadInst && !accInst && storeInst->args[0] == loadInst->dest &&
+                 isUnitStride(storeInst->args[1]) && isUnitStride(loadInst->args[0]) &&
+                 alias.alias(storeInst->args[1], loadInst->args[0], true) == OptAlias::NO_ALIAS)
+        {
+            builtin = "@__sysy_copy";
+            argVec = {storeInst->args[1], loadInst->args[0]};
+        }
+        else if (!storeInst && loadInst && accInst && isUnitStride(loadInst->args[0]))
+        {
+            builtin = "@__sysy_sum";
+            argVec = {loadInst->args[0]};
+        }
+        if (builtin.empty() || !requireBuiltin(builtin))
+            continue;
+
+        /*地址计算移到头部，头部参数即为归纳变量的初值*/
+        std::vector<IRInst> instVec;
+        instVec.push_back(cmp);
+        for (IRInst &inst : body->instVec)
+            if (&inst != storeInst && &inst != loadInst && &inst != stepInst &&
+                &inst != accInst && !inst.isTerminator())
+                instVec.push_back(inst);
+        std::string count = func->getNextVarIdent();
+        instVec.push_back(IRInst(count, std::string("sub"), {bound, iv}));
+        if (inclusive)
+        {
+            std::string inclusiveCount = func->getNextVarIdent();
+            instVec.push_back(IRInst(inclusiveCount, std::string("add"), {count, "1"}));
+            count = inclusiveCount;
+        }
+        argVec.push_back(count);
+        IRInst callInst(accInst ? func->getNextVarIdent() : std::string(), std::string("call"),
+                        argVec);
+        callInst.callee = builtin;
+        instVec.push_back(callInst);
+        if (accInst)
+        {
+            std::string sum = func->getNextVarIdent();
+            func->replaceAllUses(acc, sum);
+            instVec.push_back(IRInst(sum, std::string("add"), {acc, callInst.dest}));
+        }
+        IRInst exitInst(std::string(), std::string("jump"));
+        exitInst.labels.push_back(br.labels[1]);
+        exitInst.labelArgs.push_back(br.labelArgs[1]);
+        instVec.push_back(exitInst);
+        header->instVec = instVec;
+
+        auto &blockVec = func->blockVec;
+        blockVec.erase(std::find(blockVec.begin(), blockVec.end(), body));
+        delete body;
+        changed = true;
+    }
+    if (changed)
+        func->buildAnalysis();
+    return changed;
+}
+
+/*复制循环的所有块，块名、块参数和定义的值都换成新名字，循环内的跳转改到副本*/
+static std::vector<OptBlock *> cloneLoop(OptFunction *func, OptLoop *loop,
+                                         std::map<std::string, std::string> &nameMap)
+{
+    std::vector<OptBlock *> cloneVec;
+    for (OptBlock *block : loop->blockVec)
+    {
+        OptBlock *clone = new OptBlock(func->getNextBlockIdent());
+        nameMap[block->blockName] = clone->blockName;
+        for (auto &param : block->paramVec)
+        {
+            std::string name = func->getNextVarIdent();
+            nameMap[param.first] = name;
+            clone->paramVec.push_back(std::make_pair(name, param.second));
+        }
+        for (const IRInst &inst : block->instVec)
+        {
+            clone->instVec.push_back(inst);
+            if (!inst.dest.empty())
+                nameMap[inst.dest] = clone->instVec.back().dest = func->getNextVarIdent();
+        }
+        cloneVec.push_back(clone);
+    }
+    for (OptBlock *clone : cloneVec)
+    {
+        for (IRInst &inst : clone->instVec)
+        {
+            for (std::string *ref : inst.useRefs())
+                if (nameMap.count(*ref))
+                    *ref = nameMap[*ref];
+            for (std::string &label : inst.labels)
+                if (nameMap.count(label))
+                    label = nameMap[label];
+        }
+    }
+    auto &blockVec = func->blockVec;
+    blockVec.insert(std::find(blockVec.begin(), blockVec.end(), loop->header), cloneVec.begin(),
+                    cloneVec.end());
+    return cloneVec;
+}
+
+/*把一组跳转边改为跳到 target，参数不变*/
+static void redirectEdges(const std::vector<std::pair<OptBlock *, size_t>> &edgeVec,
+                          OptBlock *target)
+{
+    for (auto &edge : edgeVec)
+        edge.first->terminator().labels[edge.second] = target->blockName;
+}
+
+/*从 block 跳到 target 的所有边*/
+static std::vector<std::pair<OptBlock *, size_t>> findEdges(OptBlock *block, OptBlock *target)
+{
+    std::vector<std::pair<OptBlock *, size_t>> edgeVec;
+    IRInst &term = block->terminator();
+    for (size_t i = 0; i < term.labels.size(); i++)
+        if (term.labels[i] == target->blockName)
+            edgeVec.push_back(std::make_pair(block, i));
+    return edgeVec;
+}
+
+/*分支改为只走第 index 个目标的跳转*/
+static void takeBranch(IRInst &term, size_t index)
+{
+    IRInst jumpInst(std::string(), std::string("jump"));
+    jumpInst.labels.push_back(term.labels[index]);
+    jumpInst.labelArgs.push_back(term.labelArgs[index]);
+    term = jumpInst;
+}
+
+static void unrollFull(OptFunction *func, OptLoop *loop, const LoopShape &shape, int trip)
+{
+    /*依次接上 trip 个循环副本，最后回到原循环的头部时条件一定不成立*/
+    OptBlock *header = loop->header;
+    size_t headerPos = std::find(loop->blockVec.begin(), loop->blockVec.end(), header) -
+                       loop->blockVec.begin();
+    size_t latchPos = std::find(loop->blockVec.begin(), loop->blockVec.end(), shape.latch) -
+                      loop->blockVec.begin();
+    std::vector<std::pair<OptBlock *, size_t>> edgeVec;
+    std::set<OptBlock *> predSet(header->predVec.begin(), header->predVec.end());
+    for (OptBlock *pred : predSet)
+    {
+        if (loop->contains(pred))
+            continue;
+        std::vector<std::pair<OptBlock *, size_t>> predEdgeVec = findEdges(pred, header);
+        edgeVec.insert(edgeVec.end(), predEdgeVec.begin(), predEdgeVec.end());
+    }
+    for (int k = 0; k < trip; k++)
+    {
+        std::map<std::string, std::string> nameMap;
+        std::vector<OptBlock *> cloneVec = cloneLoop(func, loop, nameMap);
+        redirectEdges(edgeVec, cloneVec[headerPos]);
+        takeBranch(cloneVec[headerPos]->terminator(), 0);
+        edgeVec = findEdges(cloneVec[latchPos], cloneVec[headerPos]);
+    }
+    redirectEdges(edgeVec, header);
+    takeBranch(header->terminator(), 1);
+    func->buildCFG();
+}
+
+static void unrollPartial(OptFunction *func, OptBlock *header, const LoopShape &shape, int factor)
+{
+    /*展开后的循环每次执行 factor 次迭代，剩余的迭代仍由原循环完成*/
+    OptBlock *preheader = func->getPreheader(header->loop);
+    OptLoop *loop = header->loop;
+    size_t headerPos = std::find(loop->blockVec.begin(), loop->blockVec.end(), header) -
+                       loop->blockVec.begin();
+    size_t latchPos = std::find(loop->blockVec.begin(), loop->blockVec.end(), shape.latch) -
+                      loop->blockVec.begin();
+    std::vector<std::vector<OptBlock *>> copyVec;
+    for (int k = 0; k < factor; k++)
+    {
+        std::map<std::string, std::string> nameMap;
+        copyVec.push_back(cloneLoop(func, loop, nameMap));
+    }
+    OptBlock *mainHeader = copyVec[0][headerPos];
+
+    /*上界减去 (factor - 1) * step 不溢出时才进入展开后的循环*/
+    int span = (factor - 1) * shape.step;
+    OptBlock *guard = new OptBlock(func->getNextBlockIdent());
+    std::vector<std::string> argVec;
+    for (auto &param : header->paramVec)
+    {
+        std::string name = func->getNextVarIdent();
+        guard->paramVec.push_back(std::make_pair(name, param.second));
+        argVec.push_back(name);
+    }
+    std::string limit = func->getNextVarIdent(), safe = func->getNextVarIdent();
+    guard->instVec.push_back(
+        IRInst(limit, std::string("sub"), {shape.bound, std::to_string(span)}));
+    if (span > 0)
+        guard->instVec.push_back(IRInst(safe, std::string("ge"),
+                                        {shape.bound, std::to_string(INT_MIN + span)}));
+    else
+        guard->instVec.push_back(IRInst(safe, std::string("le"),
+                                        {shape.bound, std::to_string(INT_MAX + span)}));
+    IRInst brInst(std::string(), std::string("br"), {safe});
+    brInst.labels = {mainHeader->blockName, header->blockName};
+    brInst.labelArgs = {argVec, argVec};
+    guard->instVec.push_back(brInst);
+    auto &blockVec = func->blockVec;
+    blockVec.insert(std::find(blockVec.begin(), blockVec.end(), copyVec[0].front()), guard);
+    redirectEdges(findEdges(preheader, header), guard);
+
+    /*第一个副本的头部与新上界比较，不成立时带着当前的参数进入原循环*/
+    mainHeader->instVec[shape.cmpIndex].args[shape.ivFirst ? 1 : 0] = limit;
+    IRInst &mainTerm = mainHeader->terminator();
+    mainTerm.labels[1] = header->blockName;
+    mainTerm.labelArgs[1].clear();
+    for (auto &param : mainHeader->paramVec)
+        mainTerm.labelArgs[1].push_back(param.first);
+    for (int k = 0; k < factor; k++)
+    {
+        if (k)
+            takeBranch(copyVec[k][headerPos]->terminator(), 0);
+        redirectEdges(findEdges(copyVec[k][latchPos], copyVec[k][headerPos]),
+                      copyVec[(k + 1) % factor][headerPos]);
+    }
+    func->buildCFG();
+}
+
+bool IROptimizer::unrollLoop(OptFunction *func, bool partial)
+{
+    /*常数次迭代的小循环完全展开，其余头部无副作用的循环按 2/4/8 倍展开*/
+    static const int maxFullTrip = 32;
+    static const int maxFullSize = 200;
+    static const int maxPartialSize = 80;
+    static const int maxGrowth = 1000;
+
+    bool changed = false;
+    int budget = maxGrowth;
+    func->buildAnalysis();
+    std::vector<OptBlock *> headerVec;
+    for (OptLoop *loop : func->loopVec)
+        if (loop->childVec.empty())
+            headerVec.push_back(loop->header);
+    for (OptBlock *header : headerVec)
+    {
+        OptLoop *loop = header->loop;
+        LoopShape shape;
+        if (!loop || loop->header != header || !analyzeLoop(func, loop, shape))
+            continue;
+        int size = 0;
+        for (OptBlock *block : loop->blockVec)
+            size += block->instVec.size();
+
+        /*初值和上界都是常数时模拟求出迭代次数*/
+        std::set<std::string> initSet;
+        for (OptBlock *pred : header->predVec)
+            if (!loop->contains(pred))
+                for (auto &edge : findEdges(pred, header))
+                    initSet.insert(pred->terminator().labelArgs[edge.second][shape.ivIndex]);
+        const IRInst &cmp = header->instVec[shape.cmpIndex];
+        int trip = -1;
+        if (initSet.size() == 1 && IRInst::isConst(*initSet.begin()) &&
+            IRInst::isConst(shape.bound))
+        {
+            int value = IRInst::constValue(*initSet.begin());
+            int bound = IRInst::constValue(shape.bound);
+            int stay = 1;
+            for (trip = 0; trip <= maxFullTrip; trip++)
+            {
+                IRInst::evalBinary(cmp.op, shape.ivFirst ? value : bound,
+                                   shape.ivFirst ? bound : value, stay);
+                if (!stay)
+                    break;
+                IRInst::evalBinary(std::string("add"), value, shape.step, value);
+            }
+        }
+        if (trip >= 0 && trip <= maxFullTrip && trip * size <= std::min(maxFullSize, budget))
+        {
+            unrollFull(func, loop, shape, trip);
+            func->buildAnalysis();
+            budget -= trip * size;
+            changed = true;
+            continue;
+        }
+
+        /*只有单调的比较才能由 iv 推出之后几次迭代的条件*/
+        bool increasing = (shape.ivFirst == (cmp.op == "lt" || cmp.op == "le"));
+        if (!partial || cmp.op == "ne" || increasing != (shape.step > 0))
+            continue;
+        bool sideEffect = false;
+        for (IRInst &inst : header->instVec)
+            sideEffect |= (inst.hasSideEffect() && !inst.isTerminator());
+        int factor = 8;
+        while (factor > 1 && factor * size > std::min(maxPartialSize, budget))
+            factor /= 2;
+        if (sideEffect || factor == 1)
+            continue;
+        unrollPartial(func, header, shape, factor);
+        func->buildAnalysis();
+        budget -= (factor + 1) * size;
+        changed = true;
+    }
+    return changed;
+}
+
+/*循环不变量的线性组合，常数项的键为空串*/
+typedef std::map<std::string, int> LinearForm;
+/*链式递推 {c0, +, c1, +, c2}，第 k 次迭代时的值为 c0 + c1 * C(k, 1) + c2 * C(k, 2)*/
+typedef std::vector<LinearForm> AddRec;
+
+static const size_t maxRecLength = 3;
+
+static LinearForm addForm(const LinearForm &a, const LinearForm &b, int scale)
+{
+    LinearForm res = a;
+    for (auto &term : b)
+    {
+        unsigned coef = (unsigned)res[term.first] + (unsigned)term.second * (unsigned)scale;
+        if ((res[term.first] = (int)coef) == 0)
+            res.erase(term.first);
+    }
+    return res;
+}
+
+static bool isConstForm(const LinearForm &form)
+{
+    return form.empty() || (form.size() == 1 && form.count(""));
+}
+
+static int constOfForm(const LinearForm &form) { return form.empty() ? 0 : form.at(""); }
+
+static void trimRec(AddRec &rec)
+{
+    while (!rec.empty() && rec.back().empty())
+        rec.pop_back();
+}
+
+static AddRec combineRec(const AddRec &a, const AddRec &b, int scale)
+{
+    AddRec res = a;
+    res.resize(std::max(a.size(), b.size()));
+    for (size_t i = 0; i < b.size(); i++)
+        res[i] = addForm(res[i], b[i], scale);
+    trimRec(res);
+    return res;
+}
+
+/*一侧为不变量时才能相乘，不变量不是常数时另一侧的系数必须都是常数*/
+static bool multiplyRec(const AddRec &a, const AddRec &b, AddRec &res)
+{
+    if (b.size() > 1)
+        return a.size() <= 1 && multiplyRec(b, a, res);
+    res.clear();
+    if (b.empty())
+        return true;
+    const LinearForm &factor = b[0];
+    bool scalar = isConstForm(factor);
+    if (!scalar && factor.size() != 1)
+        return false;
+    for (const LinearForm &form : a)
+    {
+        if (scalar)
+            res.push_back(addForm(LinearForm(), form, constOfForm(factor)));
+        else if (isConstForm(form))
+            res.push_back(addForm(LinearForm(), factor, constOfForm(form)));
+        else
+            return false;
+    }
+    trimRec(res);
+    return true;
+}
+
+/*循环中的值随迭代次数的演化，只处理由头部参数经加、减、乘常数得到的值*/
+class LoopEvolution
+{
+  public:
+    OptBlock *header;
+    std::vector<std::string> initVec; /*头部参数的初值，各入口不同时为空*/
+    std::vector<std::string> nextVec; /*头部参数在回边上的值*/
+    std::set<std::string> loopDefSet;
+    std::map<std::string, IRInst *> defMap;
+    std::map<std::string, AddRec> recMap;
+    std::set<std::string> visitSet;
+    LoopEvolution(OptLoop *loop, OptBlock *latch, const std::vector<std::string> &initVec_);
+    bool evolve(const std::string &value, AddRec &rec);
+    bool increment(const std::string &value, const std::string &param, AddRec &rec);
+};
+
+LoopEvolution::LoopEvolution(OptLoop *loop, OptBlock *latch,
+                             const std::vector<std::string> &initVec_)
+    : header(loop->header), initVec(initVec_), nextVec(latch->terminator().labelArgs[0]),
+      loopDefSet(), defMap(), recMap(), visitSet()
+{
+    for (OptBlock *block : loop->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            loopDefSet.insert(param.first);
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.dest.empty())
+                continue;
+            loopDefSet.insert(inst.dest);
+            defMap[inst.dest] = &inst;
+        }
+    }
+}
+
+bool LoopEvolution::evolve(const std::string &value, AddRec &rec)
+{
+    rec.clear();
+    if (IRInst::isConst(value))
+    {
+        if (IRInst::constValue(value) != 0)
+            rec.push_back(LinearForm{{std::string(), IRInst::constValue(value)}});
+        return true;
+    }
+    if (!loopDefSet.count(value))
+    {
+        rec.push_back(LinearForm{{value, 1}});
+        return true;
+    }
+    auto iter = recMap.find(value);
+    if (iter != recMap.end())
+    {
+        rec = iter->second;
+        return true;
+    }
+    if (visitSet.count(value))
+        return false;
+
+    visitSet.insert(value);
+    bool ok = false;
+    for (size_t j = 0; j < header->paramVec.size(); j++)
+    {
+        /*头部参数的值为初值加上之前每次迭代的增量*/
+        AddRec init, step;
+        if (header->paramVec[j].first != value || initVec[j].empty() || !evolve(initVec[j], init) ||
+            !increment(nextVec[j], value, step))
+            continue;
+        rec = init;
+        rec.resize(1);
+        rec.insert(rec.end(), step.begin(), step.end());
+        trimRec(rec);
+        ok = true;
+    }
+    auto def = defMap.find(value);
+    if (def != defMap.end())
+    {
+        const IRInst &inst = *def->second;
+        AddRec lhs, rhs;
+        if ((inst.op == "add" || inst.op == "sub" || inst.op == "mul") &&
+            evolve(inst.args[0], lhs) && evolve(inst.args[1], rhs))
+        {
+            if (inst.op == "mul")
+                ok = multiplyRec(lhs, rhs, rec);
+            else
+            {
+                rec = combineRec(lhs, rhs, inst.op == "add" ? 1 : -1);
+                ok = true;
+            }
+        }
+    }
+    visitSet.erase(value);
+    if (!ok || rec.size() > maxRecLength)
+        return false;
+    recMap[value] = rec;
+    return true;
+}
+
+bool LoopEvolution::increment(const std::string &value, const std::string &param, AddRec &rec)
+{
+    /*value 为 param 加上与 param 无关的增量*/
+    rec.clear();
+    if (value == param)
+        return true;
+    auto def = defMap.find(value);
+    if (def == defMap.end())
+        return false;
+    const IRInst &inst = *def->second;
+    AddRec other;
+    if (inst.op != "add" && inst.op != "sub")
+        return false;
+    if (increment(inst.args[0], param, rec) && evolve(inst.args[1], other))
+    {
+        rec = combineRec(rec, other, inst.op == "add" ? 1 : -1);
+        return true;
+    }
+    if (inst.op == "add" && increment(inst.args[1], param, rec) && evolve(inst.args[0], other))
+    {
+        rec = combineRec(rec, other, 1);
+        return true;
+    }
+    return false;
+}
+
+/*生成一条二元运算，常数直接算出，并化简加 0 和乘 0、1*/
+static std::string emitBinary(OptFunction *func, std::vector<IRInst> &codeVec,
+                              const std::string &op, const std::string &lhs,
+                              const std::string &rhs)
+{
+    int res;
+    bool lhsConst = IRInst::isConst(lhs), rhsConst = IRInst::isConst(rhs);
+    if (lhsConst && rhsConst &&
+        IRInst::evalBinary(op, IRInst::constValue(lhs), IRInst::constValue(rhs), res))
+        return std::to_string(res);
+    if ((op == "add" || op == "sub") && rhs == "0")
+        return lhs;
+    if (op == "add" && lhs == "0")
+        return rhs;
+    if (op == "mul" && (lhs == "0" || rhs == "0"))
+        return std::string("0");
+    if (op == "mul" && (lhs == "1" || rhs == "1"))
+        return lhs == "1" ? rhs : lhs;
+    std::string dest = func->getNextVarIdent();
+    codeVec.push_back(IRInst(dest, op, {lhs, rhs}));
+    return dest;
+}
+
+static std::string emitForm(OptFunction *func, std::vector<IRInst> &codeVec,
+                            const LinearForm &form)
+{
+    std::string value("0");
+    for (auto &term : form)
+    {
+        std::string part = std::to_string(term.second);
+        if (!term.first.empty())
+            part = emitBinary(func, codeVec, std::string("mul"), term.first, part);
+        value = emitBinary(func, codeVec, std::string("add"), value, part);
+    }
+    return value;
+}
+
+/*第 trip 次迭代时的值，C(k, 2) 拆成 (k >> 1) * (k - 1) + (k & 1) * ((k - 1) >> 1) 以免溢出*/
+static std::string emitClosedForm(OptFunction *func, std::vector<IRInst> &codeVec,
+                                  const AddRec &rec, const std::string &trip)
+{
+    std::string value("0");
+    for (size_t i = 0; i < rec.size(); i++)
+    {
+        std::string coef = emitForm(func, codeVec, rec[i]), count = trip;
+        if (i == 0 || coef == "0")
+            count = std::string("1");
+        else if (i == 2)
+        {
+            std::string one("1");
+            std::string prev = emitBinary(func, codeVec, std::string("sub"), trip, one);
+            std::string half = emitBinary(func, codeVec, std::string("shr"), trip, one);
+            std::string odd = emitBinary(func, codeVec, std::string("and"), trip, one);
+            std::string prevHalf = emitBinary(func, codeVec, std::string("shr"), prev, one);
+            count = emitBinary(func, codeVec, std::string("add"),
+                               emitBinary(func, codeVec, std::string("mul"), half, prev),
+                               emitBinary(func, codeVec, std::string("mul"), odd, prevHalf));
+        }
+        std::string part = emitBinary(func, codeVec, std::string("mul"), coef, count);
+        value = emitBinary(func, codeVec, std::string("add"), value, part);
+    }
+    return value;
+}
+
+/*头部条件成立的次数，iv 经过的值都不能溢出*/
+static bool emitTripCount(OptFunction *func, std::vector<IRInst> &codeVec, const LoopShape &shape,
+                          const std::string &cmpOp, const std::string &init, std::string &trip)
+{
+    static const std::map<std::string, std::string> mirrorMap = {
+        {"lt", "gt"}, {"gt", "lt"}, {"le", "ge"}, {"ge", "le"}, {"ne", "ne"}};
+    std::string op = shape.ivFirst ? cmpOp : mirrorMap.at(cmpOp);
+    std::string bound = shape.bound;
+    if (IRInst::isConst(bound))
+    {
+        /*常数上界的 le/ge 改写为 lt/gt*/
+        int value = IRInst::constValue(bound);
+        if (op == "le" && value != INT_MAX)
+            op = "lt", bound = std::to_string(value + 1);
+        else if (op == "ge" && value != INT_MIN)
+            op = "gt", bound = std::to_string(value - 1);
+    }
+    long long step = shape.step;
+    if (IRInst::isConst(init) && IRInst::isConst(bound))
+    {
+        long long a = IRInst::constValue(init), b = IRInst::constValue(bound), count = 0;
+        if (op == "lt" && step > 0 && a < b)
+            count = (b - a + step - 1) / step;
+        else if (op == "gt" && step < 0 && a > b)
+            count = (a - b - step - 1) / -step;
+        else if (!((op == "lt" && step > 0) || (op == "gt" && step < 0)))
+            return false;
+        if (a + count * step > INT_MAX || a + count * step < INT_MIN)
+            return false;
+        trip = std::to_string((int)(unsigned)count);
+        return true;
+    }
+    if ((op != "lt" || step != 1) && (op != "gt" || step != -1))
+        return false;
+    /*步长为 1 时次数为两者之差，不进入循环时乘以 0*/
+    std::string enter = emitBinary(func, codeVec, op, init, bound);
+    std::string diff = (step == 1) ? emitBinary(func, codeVec, std::string("sub"), bound, init)
+                                   : emitBinary(func, codeVec, std::string("sub"), init, bound);
+    trip = emitBinary(func, codeVec, std::string("mul"), enter, diff);
+    return true;
+}
+
+bool IROptimizer::evaluateLoopExit(OptFunction *func)
+{
+    /*由迭代次数求出循环出口处各值的闭式，除此之外没有作用的循环整个删去*/
+    bool changed = false;
+    func->buildAnalysis();
+    std::vector<OptBlock *> headerVec;
+    for (OptLoop *loop : func->loopVec)
+        if (loop->childVec.empty())
+            headerVec.push_back(loop->header);
+    for (OptBlock *header : headerVec)
+    {
+        OptLoop *loop = header->loop;
+        LoopShape shape;
+        if (!loop || loop->header != header || !analyzeLoop(func, loop, shape))
+            continue;
+
+        /*各入口传入相同值的头部参数才有初值*/
+        std::vector<std::string> initVec(header->paramVec.size());
+        std::vector<bool> firstVec(header->paramVec.size(), true);
+        for (OptBlock *pred : header->predVec)
+        {
+            if (loop->contains(pred))
+                continue;
+            for (auto &edge : findEdges(pred, header))
+            {
+                const std::vector<std::string> &argVec = pred->terminator().labelArgs[edge.second];
+                for (size_t j = 0; j < argVec.size(); j++)
+                {
+                    if (!firstVec[j] && initVec[j] != argVec[j])
+                        initVec[j].clear();
+                    else if (firstVec[j])
+                        initVec[j] = argVec[j];
+                    firstVec[j] = false;
+                }
+            }
+        }
+        std::vector<IRInst> codeVec;
+        std::string trip;
+        const IRInst &cmp = header->instVec[shape.cmpIndex];
+        if (initVec[shape.ivIndex].empty() ||
+            !emitTripCount(func, codeVec, shape, cmp.op, initVec[shape.ivIndex], trip))
+            continue;
+        if (trip == "0")
+        {
+            takeBranch(header->terminator(), 1);
+            func->buildAnalysis();
+            changed = true;
+            continue;
+        }
+
+        /*循环外用到的循环中的值*/
+        LoopEvolution evolution(loop, shape.latch, initVec);
+        std::set<OptBlock *> blockSet = loop->blockSet;
+        std::vector<std::string> exitVec;
+        auto addExit = [&](const std::string &value)
+        {
+            if (evolution.loopDefSet.count(value) &&
+                std::find(exitVec.begin(), exitVec.end(), value) == exitVec.end())
+                exitVec.push_back(value);
+        };
+        for (OptBlock *block : func->blockVec)
+            if (!blockSet.count(block))
+                for (IRInst &inst : block->instVec)
+                    for (std::string *ref : inst.useRefs())
+                        addExit(*ref);
+        for (const std::string &arg : header->terminator().labelArgs[1])
+            addExit(arg);
+        bool pure = true;
+        for (OptBlock *block : loop->blockVec)
+            for (IRInst &inst : block->instVec)
+                pure &= (inst.isTerminator() || !inst.hasSideEffect());
+
+        /*能删去循环时替换全部出口值，否则只替换常数，此时不需要生成的指令*/
+        std::map<std::string, std::string> exitMap;
+        bool complete = true;
+        for (const std::string &value : exitVec)
+        {
+            AddRec rec;
+            if (evolution.evolve(value, rec))
+                exitMap[value] = emitClosedForm(func, codeVec, rec, trip);
+            else
+                complete = false;
+        }
+        bool remove = pure && complete;
+        if (!remove)
+            for (auto iter = exitMap.begin(); iter != exitMap.end();)
+                iter = IRInst::isConst(iter->second) ? std::next(iter) : exitMap.erase(iter);
+        if (!remove && exitMap.empty())
+            continue;
+
+        if (remove)
+        {
+            OptBlock *preheader = func->getPreheader(loop);
+            std::vector<IRInst> &instVec = preheader->instVec;
+            instVec.insert(instVec.end() - 1, codeVec.begin(), codeVec.end());
+        }
+        for (OptBlock *block : func->blockVec)
+            if (!blockSet.count(block))
+                for (IRInst &inst : block->instVec)
+                    for (std::string *ref : inst.useRefs())
+                        if (exitMap.count(*ref))
+                            *ref = exitMap[*ref];
+        for (std::string &arg : header->terminator().labelArgs[1])
+            if (exitMap.count(arg))
+                arg = exitMap[arg];
+        if (remove)
+            takeBranch(header->terminator(), 1);
+        func->buildAnalysis();
+        changed = true;
+    }
+    return changed;
+}
+
+/*两层完美嵌套的循环，外层循环中内层循环以外只有外层的条件判断、iv 的更新和跳转*/
+struct LoopNest
+{
+    OptLoop *outer;
+    OptLoop *inner;
+    LoopShape outerShape;
+    LoopShape innerShape;
+    std::string outerIV;
+    std::string innerIV;
+    std::string outerInit;
+    std::string innerInit;
+    std::vector<std::pair<OptBlock *, size_t>> outerEntryVec; /*从循环外进入外层循环的边*/
+    std::vector<std::pair<OptBlock *, size_t>> innerEntryVec; /*从外层循环体进入内层循环的边*/
+    std::map<std::string, IRInst *> defMap;                   /*整个函数中定义的值*/
+    std::set<std::string> defSet;                             /*外层循环中定义的值*/
+    std::set<std::string> chainSet; /*iv 以外的循环携带值，只能用于累加*/
+    std::vector<std::string> ptrVec;
+    std::vector<bool> writeVec;
+    OptLoop *top = NULL; /*分段时一并跨过的再外一层循环，只在三层嵌套中使用*/
+    LoopShape topShape;
+    std::string topIV;
+};
+
+/*各入口传入 index 个参数的值都相同时返回该值，否则返回空串*/
+static std::string uniqueArg(const std::vector<std::pair<OptBlock *, size_t>> &edgeVec,
+                             size_t index)
+{
+    std::string value;
+    for (auto &edge : edgeVec)
+    {
+        const std::string &arg = edge.first->terminator().labelArgs[edge.second][index];
+        if (!value.empty() && value != arg)
+            return std::string();
+        value = arg;
+    }
+    return value;
+}
+
+static bool analyzeNest(OptFunction *func, OptLoop *inner, LoopNest &nest)
+{
+    OptLoop *outer = inner->parent;
+    if (!outer || outer->childVec.size() != 1 || !analyzeLoop(func, inner, nest.innerShape) ||
+        !analyzeLoop(func, outer, nest.outerShape, false))
+        return false;
+    nest.outer = outer;
+    nest.inner = inner;
+    OptBlock *outerHeader = outer->header, *innerHeader = inner->header;
+    OptBlock *outerLatch = nest.outerShape.latch;
+    nest.outerIV = outerHeader->paramVec[nest.outerShape.ivIndex].first;
+    nest.innerIV = innerHeader->paramVec[nest.innerShape.ivIndex].first;
+    const std::string &outerNext = outerLatch->terminator().labelArgs[0][nest.outerShape.ivIndex];
+    if (inner->contains(outerLatch) || outerHeader->instVec.size() != 2)
+        return false;
+
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            if (!inst.dest.empty())
+                nest.defMap[inst.dest] = &inst;
+    nest.outerEntryVec.clear();
+    nest.innerEntryVec.clear();
+    for (OptBlock *block : func->blockVec)
+    {
+        if (outer->contains(block))
+            continue;
+        auto edgeVec = findEdges(block, outerHeader);
+        nest.outerEntryVec.insert(nest.outerEntryVec.end(), edgeVec.begin(), edgeVec.end());
+    }
+
+    /*内层循环以外除了外层 iv 的更新没有其它指令*/
+    bool hasNext = false;
+    for (OptBlock *block : outer->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            nest.defSet.insert(param.first);
+        for (IRInst &inst : block->instVec)
+        {
+            if (!inst.dest.empty())
+                nest.defSet.insert(inst.dest);
+            if (inst.op == "call")
+                return false;
+            if (inst.op == "load" || inst.op == "store")
+            {
+                nest.ptrVec.push_back(inst.args[inst.op == "load" ? 0 : 1]);
+                nest.writeVec.push_back(inst.op == "store");
+            }
+            if (inst.isTerminator() || inner->contains(block))
+                continue;
+            if (block == outerLatch && inst.dest == outerNext)
+                hasNext = true;
+            else if (block != outerHeader)
+                return false;
+        }
+        if (block == innerHeader)
+            for (IRInst &inst : block->instVec)
+                if (!inst.isTerminator() && inst.hasSideEffect())
+                    return false;
+        if (!inner->contains(block))
+        {
+            auto edgeVec = findEdges(block, innerHeader);
+            nest.innerEntryVec.insert(nest.innerEntryVec.end(), edgeVec.begin(), edgeVec.end());
+        }
+    }
+    nest.outerInit = uniqueArg(nest.outerEntryVec, nest.outerShape.ivIndex);
+    nest.innerInit = uniqueArg(nest.innerEntryVec, nest.innerShape.ivIndex);
+    if (!hasNext || nest.outerInit.empty() || nest.innerInit.empty() ||
+        nest.defSet.count(nest.innerInit) || nest.defSet.count(nest.innerShape.bound))
+        return false;
+
+    /*其余的循环携带值只经加法累加，改变迭代顺序不影响结果*/
+    auto inChain = [&](const std::string &value) { return nest.chainSet.count(value) > 0; };
+    for (OptBlock *header : {outerHeader, innerHeader})
+        for (auto &param : header->paramVec)
+            if (param.first != nest.outerIV && param.first != nest.innerIV)
+                nest.chainSet.insert(param.first);
+    for (bool grow = true; grow;)
+    {
+        grow = false;
+        for (OptBlock *block : outer->blockVec)
+        {
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.op == "add" && inChain(inst.args[0]) != inChain(inst.args[1]) &&
+                    !inChain(inst.dest))
+                {
+                    nest.chainSet.insert(inst.dest);
+                    grow = true;
+                }
+                for (size_t k = 0; k < inst.labels.size(); k++)
+                {
+                    OptBlock *target = func->findBlock(inst.labels[k]);
+                    if (!outer->contains(target))
+                        continue;
+                    for (size_t j = 0; j < inst.labelArgs[k].size(); j++)
+                    {
+                        if (!inChain(inst.labelArgs[k][j]) || inChain(target->paramVec[j].first))
+                            continue;
+                        nest.chainSet.insert(target->paramVec[j].first);
+                        grow = true;
+                    }
+                }
+            }
+        }
+    }
+    for (OptBlock *block : outer->blockVec)
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.op == "add" && inChain(inst.dest))
+            {
+                if (inChain(inst.args[0]) && inChain(inst.args[1]))
+                    return false;
+                continue;
+            }
+            for (const std::string &arg : inst.args)
+                if (inChain(arg))
+                    return false;
+            for (size_t k = 0; k < inst.labels.size(); k++)
+            {
+                OptBlock *target = func->findBlock(inst.labels[k]);
+                if (!outer->contains(target))
+                    continue;
+                for (size_t j = 0; j < inst.labelArgs[k].size(); j++)
+                    if (inChain(inst.labelArgs[k][j]) != inChain(target->paramVec[j].first))
+                        return false;
+            }
+        }
+    }
+
+    /*循环外只能用到累加的结果*/
+    auto usedOutside = [&](const std::string &value)
+    {
+        if (!nest.defSet.count(value))
+            return false;
+        for (auto &param : outerHeader->paramVec)
+            if (param.first == value && inChain(value))
+                return false;
+        return true;
+    };
+    for (const std::string &arg : outerHeader->terminator().labelArgs[1])
+        if (usedOutside(arg))
+            return false;
+    for (OptBlock *block : func->blockVec)
+        if (!outer->contains(block))
+            for (IRInst &inst : block->instVec)
+                for (std::string *ref : inst.useRefs())
+                    if (usedOutside(*ref))
+                        return false;
+    return true;
+}
+
+/*外层循环之外还有一层完美嵌套的循环时并入 nest，这层循环中只有 iv 的更新*/
+static bool extendNest(OptFunction *func, LoopNest &nest)
+{
+    OptLoop *top = nest.outer->parent;
+    LoopShape topShape;
+    if (!top || top->childVec.size() != 1 || !analyzeLoop(func, top, topShape, false))
+        return false;
+    OptBlock *topHeader = top->header, *topLatch = topShape.latch;
+    const std::string &topNext = topLatch->terminator().labelArgs[0][topShape.ivIndex];
+    if (nest.outer->contains(topLatch) || topHeader->instVec.size() != 2 ||
+        topHeader->paramVec.size() != 1)
+        return false;
+
+    bool hasNext = false;
+    std::set<std::string> topDefSet;
+    for (OptBlock *block : top->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            topDefSet.insert(param.first);
+        for (IRInst &inst : block->instVec)
+        {
+            if (!inst.dest.empty())
+                topDefSet.insert(inst.dest);
+            if (inst.isTerminator() || nest.outer->contains(block))
+                continue;
+            if (block == topLatch && inst.dest == topNext)
+                hasNext = true;
+            else if (block != topHeader)
+                return false;
+        }
+    }
+    if (!hasNext || topDefSet.count(nest.innerInit) || topDefSet.count(nest.innerShape.bound))
+        return false;
+    for (const std::string &arg : topHeader->terminator().labelArgs[1])
+        if (topDefSet.count(arg))
+            return false;
+    for (OptBlock *block : func->blockVec)
+        if (!top->contains(block))
+            for (IRInst &inst : block->instVec)
+                for (std::string *ref : inst.useRefs())
+                    if (topDefSet.count(*ref))
+                        return false;
+    nest.defSet.insert(topDefSet.begin(), topDefSet.end());
+    nest.top = top;
+    nest.topShape = topShape;
+    nest.topIV = topHeader->paramVec[topShape.ivIndex].first;
+    return true;
+}
+
+static void linearizeValue(const std::map<std::string, IRInst *> &defMap, const std::string &value,
+                           int scale, LinearForm &form, int depth)
+{
+    static const int maxDepth = 4;
+    if (IRInst::isConst(value))
+    {
+        form = addForm(form, LinearForm{{std::string(), IRInst::constValue(value)}}, scale);
+        return;
+    }
+    auto def = defMap.find(value);
+    if (depth < maxDepth && def != defMap.end())
+    {
+        const IRInst &inst = *def->second;
+        if (inst.op == "add" || inst.op == "sub")
+        {
+            linearizeValue(defMap, inst.args[0], scale, form, depth + 1);
+            linearizeValue(defMap, inst.args[1], inst.op == "add" ? scale : -scale, form,
+                           depth + 1);
+            return;
+        }
+        for (int k = 0; k < 2 && inst.op == "mul"; k++)
+        {
+            if (!IRInst::isConst(inst.args[k]))
+                continue;
+            linearizeValue(defMap, inst.args[1 - k], scale * IRInst::constValue(inst.args[k]),
+                           form, depth + 1);
+            return;
+        }
+    }
+    form = addForm(form, LinearForm{{value, 1}}, scale);
+}
+
+/*地址拆成根和各维的下标，getptr 的偏移加在它所在的那一维上*/
+static std::string splitSubscript(const std::map<std::string, IRInst *> &defMap,
+                                  const std::string &ptr, std::vector<LinearForm> &subVec)
+{
+    LinearForm carry;
+    std::string root = ptr;
+    subVec.clear();
+    for (auto def = defMap.find(root); def != defMap.end(); def = defMap.find(root))
+    {
+        const IRInst &inst = *def->second;
+        if (inst.op != "getelemptr" && inst.op != "getptr")
+            break;
+        linearizeValue(defMap, inst.args[1], 1, carry, 0);
+        if (inst.op == "getelemptr")
+        {
+            subVec.insert(subVec.begin(), carry);
+            carry.clear();
+        }
+        root = inst.args[0];
+    }
+    subVec.insert(subVec.begin(), carry);
+    return root;
+}
+
+/*逐维求出两次访问同一位置时各层 iv 的迭代距离，没有一正一负时交换或分段各层循环不改变依赖的先后*/
+static bool keepOrder(const LoopNest &nest, const std::vector<LinearForm> &subA,
+                      const std::vector<LinearForm> &subB)
+{
+    std::vector<std::string> ivVec = {nest.outerIV, nest.innerIV};
+    std::vector<int> stepVec = {nest.outerShape.step, nest.innerShape.step};
+    if (nest.top)
+    {
+        ivVec.insert(ivVec.begin(), nest.topIV);
+        stepVec.insert(stepVec.begin(), nest.topShape.step);
+    }
+    size_t count = ivVec.size();
+    std::vector<bool> knownVec(count, false);
+    std::vector<long long> distVec(count, 0);
+    for (size_t d = 0; d < subA.size(); d++)
+    {
+        LinearForm a = subA[d], b = subB[d];
+        long long coef = 0;
+        size_t k = count;
+        for (size_t t = 0; t < count; t++)
+        {
+            long long coefA = a.count(ivVec[t]) ? a[ivVec[t]] : 0;
+            if (coefA != (b.count(ivVec[t]) ? b[ivVec[t]] : 0) || (coefA != 0 && k != count))
+                return false;
+            a.erase(ivVec[t]);
+            b.erase(ivVec[t]);
+            if (coefA != 0)
+            {
+                coef = coefA;
+                k = t;
+            }
+        }
+        long long diff = (long long)(a.count("") ? a[""] : 0) - (b.count("") ? b[""] : 0);
+        a.erase("");
+        b.erase("");
+        if (a != b)
+            return false;
+        for (auto &term : a)
+            if (nest.defSet.count(term.first))
+                return false;
+        if (k == count)
+        {
+            if (diff != 0)
+                return true;
+            continue;
+        }
+        if (diff % coef != 0 || (knownVec[k] && distVec[k] != diff / coef))
+            return true;
+        knownVec[k] = true;
+        distVec[k] = diff / coef;
+    }
+    std::vector<bool> posVec(count), negVec(count);
+    for (size_t k = 0; k < count; k++)
+    {
+        if (knownVec[k] && distVec[k] % stepVec[k] != 0)
+            return true;
+        long long dist = distVec[k] / stepVec[k];
+        posVec[k] = !knownVec[k] || dist > 0;
+        negVec[k] = !knownVec[k] || dist < 0;
+    }
+    for (size_t x = 0; x < count; x++)
+        for (size_t y = 0; y < count; y++)
+            if (x != y && posVec[x] && negVec[y])
+                return false;
+    return true;
+}
+
+static bool checkDependence(const LoopNest &nest, OptAlias &alias)
+{
+    std::vector<std::string> rootVec;
+    std::vector<std::vector<LinearForm>> subVec(nest.ptrVec.size());
+    for (size_t x = 0; x < nest.ptrVec.size(); x++)
+    {
+        rootVec.push_back(splitSubscript(nest.defMap, nest.ptrVec[x], subVec[x]));
+        if (nest.defSet.count(rootVec[x]))
+            return false;
+    }
+    for (size_t x = 0; x < nest.ptrVec.size(); x++)
+    {
+        for (size_t y = x; y < nest.ptrVec.size(); y++)
+        {
+            if (!nest.writeVec[x] && !nest.writeVec[y])
+                continue;
+            if (rootVec[x] != rootVec[y])
+            {
+                if (alias.alias(nest.ptrVec[x], nest.ptrVec[y], true) != OptAlias::NO_ALIAS)
+                    return false;
+                continue;
+            }
+            if (subVec[x].size() != subVec[y].size() || !keepOrder(nest, subVec[x], subVec[y]))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*访存地址随 iv 每次迭代变化的字数*/
+static long long accessStride(OptAlias &alias, const std::string &ptr, const std::string &iv,
+                              int step)
+{
+    const OptAlias::MemLocation &loc = alias.locate(ptr);
+    auto iter = loc.termMap.find(iv);
+    return iter == loc.termMap.end() ? 0 : (long long)iter->second * step;
+}
+
+/*循环的迭代次数，初值或上界不是常数时视为很大*/
+static long long loopExtent(const LoopShape &shape, const std::string &init)
+{
+    if (!IRInst::isConst(init) || !IRInst::isConst(shape.bound))
+        return INT_MAX;
+    long long span = (long long)IRInst::constValue(shape.bound) - IRInst::constValue(init);
+    return std::abs(span / shape.step);
+}
+
+static void interchangeNest(OptFunction *func, const LoopNest &nest)
+{
+    /*两层循环交换初值、步长和条件，内层循环中两个 iv 的用处互换*/
+    OptBlock *outerHeader = nest.outer->header, *innerHeader = nest.inner->header;
+    const LoopShape &outerShape = nest.outerShape, &innerShape = nest.innerShape;
+    std::string outerOp = outerHeader->instVec[outerShape.cmpIndex].op;
+    std::string innerOp = innerHeader->instVec[innerShape.cmpIndex].op;
+    for (OptBlock *block : nest.inner->blockVec)
+        for (IRInst &inst : block->instVec)
+            for (std::string *ref : inst.useRefs())
+            {
+                if (*ref == nest.outerIV)
+                    *ref = nest.innerIV;
+                else if (*ref == nest.innerIV)
+                    *ref = nest.outerIV;
+            }
+
+    auto rebuild = [&](OptBlock *header, const std::string &iv, const LoopShape &shape,
+                       const std::string &op, const LoopShape &other)
+    {
+        std::string cmp = func->getNextVarIdent(), next = func->getNextVarIdent();
+        std::vector<std::string> argVec = {iv, shape.bound};
+        if (!shape.ivFirst)
+            std::swap(argVec[0], argVec[1]);
+        header->instVec.insert(header->instVec.end() - 1, IRInst(cmp, op, argVec));
+        header->terminator().args[0] = cmp;
+        OptBlock *latch = other.latch;
+        latch->instVec.insert(latch->instVec.end() - 1,
+                              IRInst(next, std::string("add"), {iv, std::to_string(shape.step)}));
+        latch->terminator().labelArgs[0][other.ivIndex] = next;
+    };
+    rebuild(outerHeader, nest.outerIV, innerShape, innerOp, outerShape);
+    rebuild(innerHeader, nest.innerIV, outerShape, outerOp, innerShape);
+    for (auto &edge : nest.outerEntryVec)
+        edge.first->terminator().labelArgs[edge.second][outerShape.ivIndex] = nest.innerInit;
+    for (auto &edge : nest.innerEntryVec)
+        edge.first->terminator().labelArgs[edge.second][innerShape.ivIndex] = nest.outerInit;
+}
+
+bool IROptimizer::interchangeLoop(OptFunction *func)
+{
+    /*依赖允许时交换两层完美嵌套的循环，让最内层循环中放不进缓存的跨步访存更少*/
+    static const long long minFootprint = 4096;
+
+    bool changed = false;
+    func->buildAnalysis();
+    OptAlias alias(func, this);
+    std::vector<OptBlock *> headerVec;
+    for (OptLoop *loop : func->loopVec)
+        if (loop->childVec.empty())
+            headerVec.push_back(loop->header);
+    for (OptBlock *header : headerVec)
+    {
+        LoopNest nest;
+        if (!header->loop || header->loop->header != header ||
+            !analyzeNest(func, header->loop, nest) || !checkDependence(nest, alias))
+            continue;
+        int outerCount = 0, innerCount = 0;
+        long long outerExtent = loopExtent(nest.outerShape, nest.outerInit);
+        long long innerExtent = loopExtent(nest.innerShape, nest.innerInit);
+        for (const std::string &ptr : nest.ptrVec)
+        {
+            long long outerStride = accessStride(alias, ptr, nest.outerIV, nest.outerShape.step);
+            long long innerStride = accessStride(alias, ptr, nest.innerIV, nest.innerShape.step);
+            outerCount += std::abs(outerStride) > 1 &&
+                          std::abs(outerStride) * outerExtent >= minFootprint;
+            innerCount += std::abs(innerStride) > 1 &&
+                          std::abs(innerStride) * innerExtent >= minFootprint;
+        }
+        if (outerCount >= innerCount)
+            continue;
+        interchangeNest(func, nest);
+        /*换下来的比较和 iv 更新已经不用，删掉后交换过的嵌套还能交给分段*/
+        eliminateDeadCode(func);
+        func->buildAnalysis();
+        changed = true;
+    }
+    return changed;
+}
+
+static void tileNest(OptFunction *func, const LoopNest &nest, int tile)
+{
+    /*内层循环按 tile 分段，段循环移到外层（三层嵌套时为最外层）循环之外，外层循环每次只走内层的一段*/
+    OptLoop *wrap = nest.top ? nest.top : nest.outer;
+    OptBlock *outerHeader = wrap->header, *innerHeader = nest.inner->header;
+    const std::string &bound = nest.innerShape.bound;
+    std::set<OptBlock *> outerSet = wrap->blockSet;
+    OptBlock *preheader = func->getPreheader(wrap);
+
+    OptBlock *tileHeader = new OptBlock(func->getNextBlockIdent());
+    OptBlock *tileBody = new OptBlock(func->getNextBlockIdent());
+    OptBlock *tileEntry = new OptBlock(func->getNextBlockIdent());
+    OptBlock *tileLatch = new OptBlock(func->getNextBlockIdent());
+    std::string tileIV = func->getNextVarIdent(), limit = func->getNextVarIdent();
+    std::string enter = func->getNextVarIdent(), room = func->getNextVarIdent();
+    std::string full = func->getNextVarIdent(), end = func->getNextVarIdent();
+    std::string next = func->getNextVarIdent();
+    std::string tileStr = std::to_string(tile);
+    tileHeader->paramVec.push_back(std::make_pair(tileIV, std::string("i32")));
+    tileEntry->paramVec.push_back(std::make_pair(limit, std::string("i32")));
+
+    IRInst &outerBr = outerHeader->terminator();
+    IRInst exitBr(std::string(), std::string("br"), {enter});
+    exitBr.labels = {tileBody->blockName, outerBr.labels[1]};
+    exitBr.labelArgs = {std::vector<std::string>(), outerBr.labelArgs[1]};
+    tileHeader->instVec.push_back(IRInst(enter, std::string("lt"), {tileIV, bound}));
+    tileHeader->instVec.push_back(exitBr);
+    outerBr.labels[1] = tileLatch->blockName;
+    outerBr.labelArgs[1].clear();
+
+    /*段的上界取 tileIV + tile 和 bound 中较小的，tileIV 非负时 bound - tileIV 不会溢出*/
+    IRInst limitBr(std::string(), std::string("br"), {full});
+    limitBr.labels = {tileEntry->blockName, tileEntry->blockName};
+    limitBr.labelArgs = {{end}, {bound}};
+    tileBody->instVec.push_back(IRInst(room, std::string("sub"), {bound, tileIV}));
+    tileBody->instVec.push_back(IRInst(full, std::string("gt"), {room, tileStr}));
+    tileBody->instVec.push_back(IRInst(end, std::string("add"), {tileIV, tileStr}));
+    tileBody->instVec.push_back(limitBr);
+
+    IRInst &preheaderJump = preheader->terminator();
+    IRInst entryJump(std::string(), std::string("jump"));
+    entryJump.labels.push_back(outerHeader->blockName);
+    entryJump.labelArgs.push_back(preheaderJump.labelArgs[0]);
+    tileEntry->instVec.push_back(entryJump);
+    preheaderJump.labels[0] = tileHeader->blockName;
+    preheaderJump.labelArgs[0] = {nest.innerInit};
+
+    IRInst latchJump(std::string(), std::string("jump"));
+    latchJump.labels.push_back(tileHeader->blockName);
+    latchJump.labelArgs.push_back({next});
+    tileLatch->instVec.push_back(IRInst(next, std::string("add"), {tileIV, tileStr}));
+    tileLatch->instVec.push_back(latchJump);
+
+    innerHeader->instVec[nest.innerShape.cmpIndex].args[1] = limit;
+    for (auto &edge : nest.innerEntryVec)
+        edge.first->terminator().labelArgs[edge.second][nest.innerShape.ivIndex] = tileIV;
+
+    auto &blockVec = func->blockVec;
+    auto last = std::find_if(blockVec.rbegin(), blockVec.rend(),
+                             [&](OptBlock *block) { return outerSet.count(block) > 0; });
+    blockVec.insert(last.base(), tileLatch);
+    blockVec.insert(std::find(blockVec.begin(), blockVec.end(), outerHeader),
+                    {tileHeader, tileBody, tileEntry});
+    func->buildCFG();
+}
+
+bool IROptimizer::tileLoop(OptFunction *func)
+{
+    /*内层循环跨行访存而外层循环连续访存时分段，使外层循环的各次迭代共用一段中的各行*/
+    static const int tileSize = 32;
+    static const int minExtent = 256;
+
+    bool changed = false;
+    func->buildAnalysis();
+    OptAlias alias(func, this);
+    std::vector<OptBlock *> headerVec;
+    for (OptLoop *loop : func->loopVec)
+        if (loop->childVec.empty())
+            headerVec.push_back(loop->header);
+    for (OptBlock *header : headerVec)
+    {
+        LoopNest nest;
+        if (!header->loop || header->loop->header != header ||
+            !analyzeNest(func, header->loop, nest) || !checkDependence(nest, alias))
+            continue;
+        const LoopShape &shape = nest.innerShape;
+        const IRInst &cmp = header->instVec[shape.cmpIndex];
+        if (!nest.chainSet.empty() || shape.step != 1 || cmp.op != "lt" || !shape.ivFirst ||
+            !IRInst::isConst(nest.innerInit) || IRInst::constValue(nest.innerInit) < 0 ||
+            loopExtent(shape, nest.innerInit) < minExtent)
+            continue;
+        bool profitable = false;
+        for (const std::string &ptr : nest.ptrVec)
+            profitable |=
+                std::abs(accessStride(alias, ptr, nest.innerIV, shape.step)) > 1 &&
+                std::abs(accessStride(alias, ptr, nest.outerIV, nest.outerShape.step)) <= 1;
+
+        /*矩阵乘一类的三层嵌套：与最外层 iv 无关的访存跨行走过外层循环，分段后最外层的各次迭代共用同一段*/
+        if (!profitable && extendNest(func, nest) && checkDependence(nest, alias))
+            for (const std::string &ptr : nest.ptrVec)
+                profitable |=
+                    accessStride(alias, ptr, nest.topIV, nest.topShape.step) == 0 &&
+                    std::abs(accessStride(alias, ptr, nest.outerIV, nest.outerShape.step)) > 1;
+        if (!profitable)
+            continue;
+        tileNest(func, nest, tileSize);
+        func->buildAnalysis();
+        changed = true;
+    }
+    return changed;
+}
+
+/*两个相邻循环的访存依赖，第二个循环的某次迭代依赖第一个循环更晚的迭代时不能合并*/
+static bool canFuse(OptAlias &alias, OptLoop *first, OptLoop *second, const LoopShape &shape,
+                    const std::string &firstIV, const std::string &secondIV,
+                    const std::set<std::string> &defSet)
+{
+    std::vector<std::pair<std::string, bool>> firstVec, secondVec;
+    for (OptLoop *loop : {first, second})
+        for (OptBlock *block : loop->blockVec)
+            for (IRInst &inst : block->instVec)
+            {
+                auto &accessVec = (loop == first) ? firstVec : secondVec;
+                if (inst.op == "call")
+                    return false;
+                if (inst.op == "load")
+                    accessVec.push_back(std::make_pair(inst.args[0], false));
+                else if (inst.op == "store")
+                    accessVec.push_back(std::make_pair(inst.args[1], true));
+            }
+    for (auto &a : firstVec)
+    {
+        for (auto &b : secondVec)
+        {
+            if (!a.second && !b.second)
+                continue;
+            OptAlias::MemLocation locA = alias.locate(a.first), locB = alias.locate(b.first);
+            if (locA.root != locB.root)
+            {
+                if (alias.alias(a.first, b.first, true) != OptAlias::NO_ALIAS)
+                    return false;
+                continue;
+            }
+            long long coef = locA.termMap[firstIV];
+            if (coef != locB.termMap[secondIV])
+                return false;
+            locA.termMap.erase(firstIV);
+            locB.termMap.erase(secondIV);
+            if (locA.termMap != locB.termMap)
+                return false;
+            for (auto &term : locA.termMap)
+                if (defSet.count(term.first))
+                    return false;
+            long long diff = (long long)locB.offset - locA.offset;
+            if (coef == 0)
+            {
+                if (diff == 0)
+                    return false;
+                continue;
+            }
+            if (diff % coef != 0 || (diff / coef) % shape.step != 0)
+                continue;
+            if (diff / coef / shape.step > 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void fuseLoops(OptFunction *func, OptLoop *first, OptLoop *second,
+                      const LoopShape &firstShape, const LoopShape &secondShape)
+{
+    /*第一个循环的回边改为进入第二个循环体，第二个循环的回边回到第一个循环的头部，
+      第二个循环头部的参数并入第一个循环的头部*/
+    OptBlock *firstHeader = first->header, *secondHeader = second->header;
+    IRInst &firstBr = firstHeader->terminator();
+    std::vector<std::string> initVec = firstBr.labelArgs[1];
+    std::vector<std::string> backVec = firstShape.latch->terminator().labelArgs[0];
+    std::map<std::string, std::string> renameMap;
+    std::vector<std::pair<OptBlock *, size_t>> entryVec;
+    for (OptBlock *block : func->blockVec)
+    {
+        if (first->contains(block))
+            continue;
+        auto edgeVec = findEdges(block, firstHeader);
+        entryVec.insert(entryVec.end(), edgeVec.begin(), edgeVec.end());
+    }
+    for (size_t k = 0; k < secondHeader->paramVec.size(); k++)
+    {
+        auto &param = secondHeader->paramVec[k];
+        if ((int)k == secondShape.ivIndex)
+        {
+            renameMap[param.first] = firstHeader->paramVec[firstShape.ivIndex].first;
+            continue;
+        }
+        std::string name = func->getNextVarIdent();
+        renameMap[param.first] = name;
+        firstHeader->paramVec.push_back(std::make_pair(name, param.second));
+        for (auto &edge : entryVec)
+            edge.first->terminator().labelArgs[edge.second].push_back(initVec[k]);
+        backVec.push_back(secondShape.latch->terminator().labelArgs[0][k]);
+    }
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            for (std::string *ref : inst.useRefs())
+                if (renameMap.count(*ref))
+                    *ref = renameMap[*ref];
+    for (std::string &arg : backVec)
+        if (renameMap.count(arg))
+            arg = renameMap[arg];
+    secondHeader->paramVec.clear();
+
+    IRInst &firstLatchJump = firstShape.latch->terminator();
+    firstLatchJump.labels[0] = secondHeader->blockName;
+    firstLatchJump.labelArgs[0].clear();
+    IRInst &secondBr = secondHeader->terminator();
+    firstBr.labels[1] = secondBr.labels[1];
+    firstBr.labelArgs[1] = secondBr.labelArgs[1];
+    takeBranch(secondBr, 0);
+    IRInst &secondLatchJump = secondShape.latch->terminator();
+    secondLatchJump.labels[0] = firstHeader->blockName;
+    secondLatchJump.labelArgs[0] = backVec;
+    func->buildCFG();
+}
+
+bool IROptimizer::fuseLoop(OptFunction *func)
+{
+    /*合并首尾相接、迭代范围相同的两个最内层循环，每次合并后重新分析以便继续合并*/
+    bool changed = false;
+    for (bool fused = true; fused;)
+    {
+        fused = false;
+        func->buildAnalysis();
+        OptAlias alias(func, this);
+        for (OptLoop *first : func->loopVec)
+        {
+            LoopShape firstShape, secondShape;
+            if (!analyzeLoop(func, first, firstShape))
+                continue;
+            OptBlock *firstHeader = first->header;
+            IRInst &firstBr = firstHeader->terminator();
+            OptBlock *secondHeader = func->findBlock(firstBr.labels[1]);
+            OptLoop *second = secondHeader->loop;
+            if (!second || second->header != secondHeader ||
+                !analyzeLoop(func, second, secondShape) || secondHeader->instVec.size() != 2)
+                continue;
+            for (OptBlock *pred : secondHeader->predVec)
+            {
+                if (!second->contains(pred) && pred != firstHeader)
+                {
+                    second = NULL;
+                    break;
+                }
+            }
+            if (!second || findEdges(firstHeader, secondHeader).size() != 1)
+                continue;
+
+            /*两个循环的 iv 从同一初值以同一步长走到同一上界*/
+            const IRInst &firstCmp = firstHeader->instVec[firstShape.cmpIndex];
+            const IRInst &secondCmp = secondHeader->instVec[secondShape.cmpIndex];
+            std::vector<std::pair<OptBlock *, size_t>> entryVec;
+            for (OptBlock *block : func->blockVec)
+            {
+                if (first->contains(block))
+                    continue;
+                auto edgeVec = findEdges(block, firstHeader);
+                entryVec.insert(entryVec.end(), edgeVec.begin(), edgeVec.end());
+            }
+            std::string firstInit = uniqueArg(entryVec, firstShape.ivIndex);
+            if (firstCmp.op != secondCmp.op || firstShape.ivFirst != secondShape.ivFirst ||
+                firstShape.bound != secondShape.bound || firstShape.step != secondShape.step ||
+                firstInit.empty() || firstInit != firstBr.labelArgs[1][secondShape.ivIndex])
+                continue;
+
+            /*第二个循环不能用到第一个循环中的值，头部除了比较和跳转没有别的指令*/
+            std::set<std::string> firstDefSet, defSet;
+            for (OptLoop *loop : {first, second})
+                for (OptBlock *block : loop->blockVec)
+                {
+                    auto &loopDefSet = (loop == first) ? firstDefSet : defSet;
+                    for (auto &param : block->paramVec)
+                        loopDefSet.insert(param.first);
+                    for (IRInst &inst : block->instVec)
+                        if (!inst.dest.empty())
+                            loopDefSet.insert(inst.dest);
+                }
+            defSet.insert(firstDefSet.begin(), firstDefSet.end());
+            bool legal = true;
+            for (const std::string &arg : firstBr.labelArgs[1])
+                legal &= !defSet.count(arg);
+            for (OptBlock *block : second->blockVec)
+                for (IRInst &inst : block->instVec)
+                    for (std::string *ref : inst.useRefs())
+                        legal &= !firstDefSet.count(*ref);
+            for (IRInst &inst : firstHeader->instVec)
+                legal &= (inst.isTerminator() || !inst.hasSideEffect());
+            const std::string &firstIV = firstHeader->paramVec[firstShape.ivIndex].first;
+            const std::string &secondIV = secondHeader->paramVec[secondShape.ivIndex].first;
+            if (!legal ||
+                !canFuse(alias, first, second, firstShape, firstIV, secondIV, defSet))
+                continue;
+            fuseLoops(func, first, second, firstShape, secondShape);
+            fused = changed = true;
+            break;
+        }
+    }
+    return changed;
+}
+
+/*循环中不变的值，不变的 load 只能读全局变量或局部变量的固定位置，并且循环中没有可能写它的指令*/
+class LoopInvariance
+{
+  public:
+    OptAlias &alias;
+    std::set<std::string> defSet;           /*循环中定义的值*/
+    std::map<std::string, IRInst *> defMap; /*循环中的指令*/
+    std::vector<IRInst *> writeVec;         /*循环中的 store 和 call*/
+    LoopInvariance(OptLoop *loop, OptAlias &alias_);
+    bool isInvariant(const std::string &value, int depth = 0);
+    std::string hoist(OptFunction *func, const std::string &value,
+                      std::map<std::string, std::string> &hoistMap, std::vector<IRInst> &codeVec);
+};
+
+LoopInvariance::LoopInvariance(OptLoop *loop, OptAlias &alias_)
+    : alias(alias_), defSet(), defMap(), writeVec()
+{
+    for (OptBlock *block : loop->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            defSet.insert(param.first);
+        for (IRInst &inst : block->instVec)
+        {
+            if (!inst.dest.empty())
+            {
+                defSet.insert(inst.dest);
+                defMap[inst.dest] = &inst;
+            }
+            if (inst.op == "store" || inst.op == "call")
+                writeVec.push_back(&inst);
+        }
+    }
+}
+
+bool LoopInvariance::isInvariant(const std::string &value, int depth)
+{
+    static const int maxDepth = 8;
+    if (IRInst::isConst(value) || !defSet.count(value))
+        return true;
+    auto def = defMap.find(value);
+    if (def == defMap.end() || depth >= maxDepth)
+        return false;
+    const IRInst &inst = *def->second;
+    if (inst.isBinary() || inst.op == "getelemptr" || inst.op == "getptr")
+        return isInvariant(inst.args[0], depth + 1) && isInvariant(inst.args[1], depth + 1);
+    if (inst.op != "load" || !isInvariant(inst.args[0], depth + 1))
+        return false;
+
+    /*提到循环外的 load 可能被多执行一次，只允许读一定有效的地址*/
+    const std::string &ptr = inst.args[0];
+    const OptAlias::MemLocation &loc = alias.locate(ptr);
+    if ((loc.kind != OptAlias::ROOT_GLOBAL && loc.kind != OptAlias::ROOT_ALLOC) ||
+        !loc.termMap.empty())
+        return false;
+    for (IRInst *write : writeVec)
+    {
+        if (write->op == "store" && alias.alias(write->args[1], ptr) != OptAlias::NO_ALIAS)
+            return false;
+        if (write->op == "call" && alias.callMayTouch(*write, ptr, true))
+            return false;
+    }
+    return true;
+}
+
+std::string LoopInvariance::hoist(OptFunction *func, const std::string &value,
+                                  std::map<std::string, std::string> &hoistMap,
+                                  std::vector<IRInst> &codeVec)
+{
+    /*按依赖顺序把计算 value 的指令复制到循环外*/
+    auto def = defMap.find(value);
+    if (def == defMap.end())
+        return value;
+    if (hoistMap.count(value))
+        return hoistMap[value];
+    IRInst inst = *def->second;
+    for (std::string &arg : inst.args)
+        arg = hoist(func, arg, hoistMap, codeVec);
+    inst.dest = func->getNextVarIdent();
+    codeVec.push_back(inst);
+    return hoistMap[value] = inst.dest;
+}
+
+static bool unswitchBranch(OptFunction *func, OptLoop *loop, OptBlock *block,
+                           LoopInvariance &invariance)
+{
+    /*条件提到前置块中计算，原循环走真分支，副本走假分支，循环外用到的值经出口的参数传出*/
+    OptBlock *header = loop->header;
+    std::string cond = block->terminator().args[0];
+    std::set<OptBlock *> blockSet = loop->blockSet;
+    OptBlock *exit = NULL;
+    for (OptBlock *loopBlock : loop->blockVec)
+        for (OptBlock *succ : loopBlock->succVec)
+            if (!blockSet.count(succ))
+                exit = succ;
+    OptBlock *preheader = func->getPreheader(loop);
+    if (preheader->terminator().op != "jump")
+        return false;
+
+    std::vector<IRInst> codeVec;
+    std::map<std::string, std::string> hoistMap;
+    std::string hoisted = invariance.hoist(func, cond, hoistMap, codeVec);
+    preheader->instVec.insert(preheader->instVec.end() - 1, codeVec.begin(), codeVec.end());
+
+    std::map<std::string, std::string> renameMap;
+    for (OptBlock *outside : func->blockVec)
+    {
+        if (blockSet.count(outside))
+            continue;
+        for (IRInst &inst : outside->instVec)
+        {
+            for (std::string *ref : inst.useRefs())
+            {
+                if (!invariance.defSet.count(*ref))
+                    continue;
+                if (!renameMap.count(*ref))
+                {
+                    std::string name = func->getNextVarIdent();
+                    exit->paramVec.push_back(std::make_pair(name, invariance.alias.typeMap[*ref]));
+                    for (OptBlock *loopBlock : blockSet)
+                    {
+                        IRInst &term = loopBlock->terminator();
+                        for (size_t k = 0; k < term.labels.size(); k++)
+                            if (term.labels[k] == exit->blockName)
+                                term.labelArgs[k].push_back(*ref);
+                    }
+                    renameMap[*ref] = name;
+                }
+                *ref = renameMap[*ref];
+            }
+        }
+    }
+
+    std::map<std::string, std::string> nameMap;
+    cloneLoop(func, header->loop, nameMap);
+    std::string cloneCond = nameMap.count(cond) ? nameMap[cond] : cond;
+    for (OptBlock *loopBlock : blockSet)
+    {
+        IRInst &term = loopBlock->terminator();
+        if (term.op == "br" && term.args[0] == cond)
+            takeBranch(term, 0);
+        /*副本中条件一定为 0*/
+        OptBlock *clone = func->findBlock(nameMap[loopBlock->blockName]);
+        IRInst &cloneTerm = clone->terminator();
+        if (cloneTerm.op == "br" && cloneTerm.args[0] == cloneCond)
+            takeBranch(cloneTerm, 1);
+        for (IRInst &inst : clone->instVec)
+            for (std::string *ref : inst.useRefs())
+                if (*ref == cloneCond)
+                    *ref = std::string("0");
+    }
+    IRInst &jump = preheader->terminator();
+    IRInst brInst(std::string(), std::string("br"), {hoisted});
+    brInst.labels = {header->blockName, nameMap[header->blockName]};
+    brInst.labelArgs = {jump.labelArgs[0], jump.labelArgs[0]};
+    jump = brInst;
+    func->buildCFG();
+    return true;
+}
+
+bool IROptimizer::unswitchLoop(OptFunction *func)
+{
+    /*最内层循环中条件不变的分支提到循环之前，按条件的两种结果各保留一份循环*/
+    static const int maxLoopSize = 80;
+    static const int maxGrowth = 400;
+
+    bool changed = false;
+    int budget = maxGrowth;
+    for (bool unswitched = true; unswitched;)
+    {
+        unswitched = false;
+        func->buildAnalysis();
+        OptAlias alias(func, this);
+        for (OptLoop *loop : func->loopVec)
+        {
+            int size = 0;
+            std::set<OptBlock *> exitSet;
+            for (OptBlock *block : loop->blockVec)
+            {
+                size += block->instVec.size();
+                for (OptBlock *succ : block->succVec)
+                    if (!loop->contains(succ))
+                        exitSet.insert(succ);
+            }
+            if (!loop->childVec.empty() || size > std::min(maxLoopSize, budget) ||
+                exitSet.size() != 1)
+                continue;
+            bool dedicated = true;
+            for (OptBlock *pred : (*exitSet.begin())->predVec)
+                dedicated &= loop->contains(pred);
+            if (!dedicated)
+                continue;
+            OptBlock *target = NULL;
+            LoopInvariance invariance(loop, alias);
+            for (OptBlock *block : loop->blockVec)
+            {
+                const IRInst &term = block->terminator();
+                if (target || term.op != "br" || term.labels[0] == term.labels[1] ||
+                    IRInst::isConst(term.args[0]) || !invariance.isInvariant(term.args[0]))
+                    continue;
+                if (loop->contains(func->findBlock(term.labels[0])) &&
+                    loop->contains(func->findBlock(term.labels[1])))
+                    target = block;
+            }
+            if (!target)
+                continue;
+            if (unswitchBranch(func, loop, target, invariance))
+            {
+                budget -= size;
+                changed = unswitched = true;
+            }
+            break;
+        }
+    }
+    return changed;
+}
+
+/* END */
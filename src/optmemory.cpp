@@ -0,0 +1,870 @@
+#include "iroptimizer.hpp"
+#include <algorithm>
+#include <functional>
+
+bool IROptimizer::libCallTouch(const std::string &callee, size_t index, bool write)
+{
+    /*库函数和内建函数经指针参数访问内存的方式，按参数顺序 r 为读，w 为写*/
+    static const char *accessTable[][2] = {{"@getarray", "w"},      {"@putarray", ".r"},
+                                           {"@__sysy_fill", "w.."}, {"@__sysy_copy", "wr."},
+                                           {"@__sysy_sum", "r."},   {NULL, NULL}};
+    for (auto p = accessTable; (*p)[0]; p++)
+        if (callee == (*p)[0])
+            return index < std::string((*p)[1]).size() && (*p)[1][index] == (write ? 'w' : 'r');
+    return false;
+}
+
+void IROptimizer::buildModRef()
+{
+    /*每个函数直接或间接读写的全局变量，经指针参数读写时记为 * */
+    struct CallSite
+    {
+        std::string caller;
+        std::string callee;
+        std::vector<std::string> argRootVec; /*指针实参的来源，局部变量为空*/
+    };
+    funcModMap.clear();
+    funcRefMap.clear();
+    std::vector<CallSite> callSiteVec;
+    bool unknownWrite = false;
+    for (OptFunction *func : funcVec)
+    {
+        std::string name = "@" + func->funcName;
+        std::set<std::string> &modSet = funcModMap[name];
+        std::set<std::string> &refSet = funcRefMap[name];
+        OptAlias alias(func, this);
+        auto getRoot = [&alias](const std::string &ptr) -> std::string
+        {
+            const OptAlias::MemLocation &loc = alias.locate(ptr);
+            if (loc.kind == OptAlias::ROOT_ALLOC)
+                return std::string();
+            return loc.kind == OptAlias::ROOT_GLOBAL ? loc.root : std::string("*");
+        };
+        auto markWrite = [&alias, &getRoot, &modSet, &unknownWrite](const std::string &ptr)
+        {
+            modSet.insert(getRoot(ptr));
+            unknownWrite |= (alias.locate(ptr).kind == OptAlias::ROOT_UNKNOWN);
+        };
+        for (OptBlock *block : func->blockVec)
+        {
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.op == "load")
+                    refSet.insert(getRoot(inst.args[0]));
+                else if (inst.op == "store")
+                    markWrite(inst.args[1]);
+                else if (inst.op == "call")
+                {
+                    CallSite site = {name, inst.callee, std::vector<std::string>()};
+                    for (const std::string &arg : inst.args)
+                        if (alias.isPointer(arg))
+                            site.argRootVec.push_back(getRoot(arg));
+                    if (findFunc(inst.callee))
+                    {
+                        callSiteVec.push_back(site);
+                        continue;
+                    }
+                    for (size_t i = 0; i < inst.args.size(); i++)
+                    {
+                        if (libCallTouch(inst.callee, i, true))
+                            markWrite(inst.args[i]);
+                        if (libCallTouch(inst.callee, i, false))
+                            refSet.insert(getRoot(inst.args[i]));
+                    }
+                }
+            }
+        }
+        modSet.erase(std::string());
+        refSet.erase(std::string());
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (CallSite &site : callSiteVec)
+        {
+            for (auto touchMap : {&funcModMap, &funcRefMap})
+            {
+                std::set<std::string> &callerSet = (*touchMap)[site.caller];
+                std::set<std::string> &calleeSet = (*touchMap)[site.callee];
+                size_t size = callerSet.size();
+                for (const std::string &global : calleeSet)
+                    if (global != "*")
+                        callerSet.insert(global);
+                if (calleeSet.count("*"))
+                    for (const std::string &root : site.argRootVec)
+                        if (!root.empty())
+                            callerSet.insert(root);
+                changed |= (callerSet.size() != size);
+            }
+        }
+    }
+
+    /*整个程序都不写的全局变量，存在来源未知的写时无法确定*/
+    readOnlySet.clear();
+    for (const IRInst &global : unknownWrite ? std::vector<IRInst>() : globalVec)
+    {
+        bool written = false;
+        for (auto &p : funcModMap)
+            written |= (p.second.count(global.dest) != 0);
+        if (!written)
+            readOnlySet.insert(global.dest);
+    }
+}
+
+bool IROptimizer::localizeGlobal()
+{
+    /*只在 main 中直接读写的 i32 全局变量改为 main 的局部变量*/
+    OptFunction *mainFunc = findFunc("@main");
+    std::map<std::string, bool> localMap;
+    for (const IRInst &global : globalVec)
+        if (global.type == "i32")
+            localMap[global.dest] = true;
+
+    for (OptFunction *func : funcVec)
+    {
+        for (OptBlock *block : func->blockVec)
+        {
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.op == "call" && inst.callee == "@main")
+                    return false;
+                for (size_t i = 0; i < inst.args.size(); i++)
+                {
+                    if (!localMap.count(inst.args[i]))
+                        continue;
+                    bool access = (inst.op == "load" && i == 0) || (inst.op == "store" && i == 1);
+                    if (func != mainFunc || !access)
+                        localMap[inst.args[i]] = false;
+                }
+                for (const std::vector<std::string> &argVec : inst.labelArgs)
+                    for (const std::string &arg : argVec)
+                        if (localMap.count(arg))
+                            localMap[arg] = false;
+            }
+        }
+    }
+
+    std::vector<IRInst> newGlobalVec;
+    std::vector<IRInst> initVec;
+    for (const IRInst &global : globalVec)
+    {
+        if (!localMap.count(global.dest) || !localMap[global.dest])
+        {
+            newGlobalVec.push_back(global);
+            continue;
+        }
+        IRInst allocInst(global.dest, std::string("alloc"));
+        allocInst.type = global.type;
+        std::string init = IRInst::isConst(global.args[0]) ? global.args[0] : std::string("0");
+        initVec.push_back(allocInst);
+        initVec.push_back(IRInst(std::string(), std::string("store"), {init, global.dest}));
+    }
+    if (initVec.empty())
+        return false;
+    globalVec = newGlobalVec;
+    std::vector<IRInst> &entryVec = mainFunc->blockVec.front()->instVec;
+    entryVec.insert(entryVec.begin(), initVec.begin(), initVec.end());
+    return true;
+}
+
+bool IROptimizer::promoteGlobal(OptFunction *func)
+{
+    /*循环中读写的 i32 全局变量，在前置块读入局部变量，出口处和调用前后写回*/
+    std::set<std::string> scalarSet;
+    for (const IRInst &global : globalVec)
+        if (global.type == "i32")
+            scalarSet.insert(global.dest);
+    if (scalarSet.empty())
+        return false;
+
+    bool changed = false;
+    func->buildAnalysis();
+    std::vector<OptLoop *> topLoopVec;
+    for (OptLoop *loop : func->loopVec)
+        if (loop->depth == 1)
+            topLoopVec.push_back(loop);
+    std::vector<OptBlock *> headerVec;
+    for (OptLoop *loop : topLoopVec)
+        headerVec.push_back(loop->header);
+
+    for (OptBlock *header : headerVec)
+    {
+        OptLoop *loop = header->loop;
+        std::map<std::string, int> accessCount, callCount;
+        std::set<std::string> storedSet;
+        for (OptBlock *block : loop->blockVec)
+        {
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.op == "load" && scalarSet.count(inst.args[0]))
+                    accessCount[inst.args[0]]++;
+                else if (inst.op == "store" && scalarSet.count(inst.args[1]))
+                {
+                    accessCount[inst.args[1]]++;
+                    storedSet.insert(inst.args[1]);
+                }
+                else if (inst.op == "call" && findFunc(inst.callee))
+                {
+                    for (const std::string &global : funcModMap[inst.callee])
+                        callCount[global]++;
+                    for (const std::string &global : funcRefMap[inst.callee])
+                        if (!funcModMap[inst.callee].count(global))
+                            callCount[global]++;
+                }
+            }
+        }
+
+        /*被调用的函数访问得比循环本身还多时不值得提升*/
+        std::map<std::string, std::string> promoteMap;
+        for (auto &p : accessCount)
+            if (callCount[p.first] < p.second)
+                promoteMap[p.first] = func->getNextVarIdent();
+        if (promoteMap.empty())
+            continue;
+
+        OptBlock *preheader = func->getPreheader(loop);
+        loop = header->loop;
+        std::vector<IRInst> &entryVec = func->blockVec.front()->instVec;
+        std::vector<IRInst> loadVec;
+        for (auto &p : promoteMap)
+        {
+            IRInst allocInst(p.second, std::string("alloc"));
+            allocInst.type = std::string("i32");
+            entryVec.insert(entryVec.begin(), allocInst);
+            std::string value = func->getNextVarIdent();
+            loadVec.push_back(IRInst(value, std::string("load"), {p.first}));
+            loadVec.push_back(IRInst(std::string(), std::string("store"), {value, p.second}));
+        }
+        std::vector<IRInst> &preVec = preheader->instVec;
+        preVec.insert(preVec.end() - 1, loadVec.begin(), loadVec.end());
+
+        for (OptBlock *block : loop->blockVec)
+        {
+            std::vector<IRInst> instVec;
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.op == "load" && promoteMap.count(inst.args[0]))
+                    inst.args[0] = promoteMap[inst.args[0]];
+                if (inst.op == "store" && promoteMap.count(inst.args[1]))
+                    inst.args[1] = promoteMap[inst.args[1]];
+                if (inst.op != "call" || !findFunc(inst.callee))
+                {
+                    instVec.push_back(inst);
+                    continue;
+                }
+                std::set<std::string> &modSet = funcModMap[inst.callee];
+                std::set<std::string> &refSet = funcRefMap[inst.callee];
+                for (auto &p : promoteMap)
+                {
+                    if (!modSet.count(p.first) && !refSet.count(p.first))
+                        continue;
+                    std::string value = func->getNextVarIdent();
+                    instVec.push_back(IRInst(value, std::string("load"), {p.second}));
+                    instVec.push_back(IRInst(std::string(), std::string("store"), {value, p.first}));
+                }
+                instVec.push_back(inst);
+                for (auto &p : promoteMap)
+                {
+                    if (!modSet.count(p.first))
+                        continue;
+                    std::string value = func->getNextVarIdent();
+                    instVec.push_back(IRInst(value, std::string("load"), {p.first}));
+                    instVec.push_back(IRInst(std::string(), std::string("store"), {value, p.second}));
+                }
+            }
+            block->instVec = instVec;
+        }
+
+        /*拆分出口边，写回循环中修改过的全局变量*/
+        std::vector<std::pair<OptBlock *, size_t>> exitEdgeVec;
+        bool stored = false;
+        for (auto &p : promoteMap)
+            stored |= storedSet.count(p.first) != 0;
+        for (OptBlock *block : stored ? loop->blockVec : std::vector<OptBlock *>())
+        {
+            IRInst &term = block->terminator();
+            for (size_t i = 0; i < term.labels.size(); i++)
+                if (!loop->contains(func->findBlock(term.labels[i])))
+                    exitEdgeVec.push_back(std::make_pair(block, i));
+        }
+        for (auto &edge : exitEdgeVec)
+        {
+            OptBlock *exitBlock = func->splitEdge(edge.first, edge.second);
+            std::vector<IRInst> storeVec;
+            for (auto &p : promoteMap)
+            {
+                if (!storedSet.count(p.first))
+                    continue;
+                std::string value = func->getNextVarIdent();
+                storeVec.push_back(IRInst(value, std::string("load"), {p.second}));
+                storeVec.push_back(IRInst(std::string(), std::string("store"), {value, p.first}));
+            }
+            exitBlock->instVec.insert(exitBlock->instVec.begin(), storeVec.begin(), storeVec.end());
+        }
+        func->buildAnalysis();
+        changed = true;
+    }
+    return changed;
+}
+
+bool IROptimizer::promoteAlloc(OptFunction *func)
+{
+    /*把只被 load/store 直接访问的 i32 局部变量提升为 SSA 值，汇合处用基本块参数*/
+    std::set<std::string> promoteSet;
+    std::map<std::string, std::string> typeMap;
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            if (inst.op == "alloc" && (inst.type == "i32" || inst.type[0] == '*'))
+            {
+                promoteSet.insert(inst.dest);
+                typeMap[inst.dest] = inst.type;
+            }
+
+    /*指针变量只来自参数，要求在入口块中先写后读*/
+    std::map<std::string, int> entryStoreCount;
+    for (IRInst &inst : func->blockVec.front()->instVec)
+    {
+        if (inst.op == "load" && promoteSet.count(inst.args[0]) && !entryStoreCount[inst.args[0]])
+            promoteSet.erase(inst.args[0]);
+        if (inst.op == "store" && promoteSet.count(inst.args[1]))
+            entryStoreCount[inst.args[1]]++;
+    }
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            if (inst.op == "store" && promoteSet.count(inst.args[1]) &&
+                typeMap[inst.args[1]][0] == '*' &&
+                (block != func->blockVec.front() || entryStoreCount[inst.args[1]] != 1))
+                promoteSet.erase(inst.args[1]);
+    for (OptBlock *block : func->blockVec)
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            for (size_t i = 0; i < inst.args.size(); i++)
+            {
+                bool access = (inst.op == "load" && i == 0) || (inst.op == "store" && i == 1);
+                if (!access)
+                    promoteSet.erase(inst.args[i]);
+            }
+            for (const std::vector<std::string> &argVec : inst.labelArgs)
+                for (const std::string &arg : argVec)
+                    promoteSet.erase(arg);
+        }
+    }
+    if (promoteSet.empty())
+        return false;
+
+    func->buildAnalysis();
+
+    /*支配边界*/
+    std::map<OptBlock *, std::set<OptBlock *>> frontierMap;
+    for (OptBlock *block : func->blockVec)
+    {
+        if (block->predVec.size() < 2)
+            continue;
+        for (OptBlock *pred : block->predVec)
+            for (OptBlock *runner = pred; runner != block->idom; runner = runner->idom)
+                frontierMap[runner].insert(block);
+    }
+
+    /*在写入块的迭代支配边界处放置块参数*/
+    std::map<OptBlock *, std::vector<std::string>> phiMap; /*块 -> 新增参数对应的变量*/
+    for (const std::string &var : promoteSet)
+    {
+        std::vector<OptBlock *> worklist;
+        std::set<OptBlock *> placed;
+        for (OptBlock *block : func->blockVec)
+            for (IRInst &inst : block->instVec)
+                if (inst.op == "store" && inst.args[1] == var)
+                {
+                    worklist.push_back(block);
+                    break;
+                }
+        std::set<OptBlock *> visited(worklist.begin(), worklist.end());
+        while (!worklist.empty())
+        {
+            OptBlock *block = worklist.back();
+            worklist.pop_back();
+            for (OptBlock *frontier : frontierMap[block])
+            {
+                if (!placed.insert(frontier).second)
+                    continue;
+                phiMap[frontier].push_back(var);
+                if (visited.insert(frontier).second)
+                    worklist.push_back(frontier);
+            }
+        }
+    }
+    for (OptBlock *block : func->blockVec)
+    {
+        std::vector<std::string> &varVec = phiMap[block];
+        std::sort(varVec.begin(), varVec.end());
+        for (const std::string &var : varVec)
+            block->paramVec.push_back(std::make_pair(func->getNextVarIdent(), typeMap[var]));
+    }
+
+    /*沿支配树重命名*/
+    std::map<std::string, std::vector<std::string>> stackMap;
+    std::map<std::string, std::string> replaceMap;
+    auto current = [&stackMap](const std::string &var) -> std::string
+    {
+        std::vector<std::string> &stack = stackMap[var];
+        return stack.empty() ? std::string("0") : stack.back();
+    };
+
+    std::function<void(OptBlock *)> rename = [&](OptBlock *block)
+    {
+        std::vector<std::string> pushedVec;
+        std::vector<std::string> &varVec = phiMap[block];
+        size_t firstParam = block->paramVec.size() - varVec.size();
+        for (size_t i = 0; i < varVec.size(); i++)
+        {
+            stackMap[varVec[i]].push_back(block->paramVec[firstParam + i].first);
+            pushedVec.push_back(varVec[i]);
+        }
+
+        std::vector<IRInst> instVec;
+        for (IRInst &inst : block->instVec)
+        {
+            for (std::string *ref : inst.useRefs())
+                if (replaceMap.count(*ref))
+                    *ref = replaceMap[*ref];
+            if (inst.op == "alloc" && promoteSet.count(inst.dest))
+                continue;
+            if (inst.op == "load" && promoteSet.count(inst.args[0]))
+            {
+                replaceMap[inst.dest] = current(inst.args[0]);
+                continue;
+            }
+            if (inst.op == "store" && promoteSet.count(inst.args[1]))
+            {
+                stackMap[inst.args[1]].push_back(inst.args[0]);
+                pushedVec.push_back(inst.args[1]);
+                continue;
+            }
+            instVec.push_back(inst);
+        }
+        block->instVec = instVec;
+
+        IRInst &term = block->terminator();
+        for (size_t i = 0; i < term.labels.size(); i++)
+            for (const std::string &var : phiMap[func->findBlock(term.labels[i])])
+                term.labelArgs[i].push_back(current(var));
+
+        for (OptBlock *child : block->domChildVec)
+            rename(child);
+        for (const std::string &var : pushedVec)
+            stackMap[var].pop_back();
+    };
+    rename(func->blockVec.front());
+    func->buildCFG();
+    return true;
+}
+
+bool IROptimizer::forwardMemory(OptFunction *func)
+{
+    /*沿支配树把 load 替换为同一地址上最近一次 store 或 load 的值*/
+    static const size_t maxAvailCount = 64;
+
+    func->buildAnalysis();
+    OptAlias alias(func, this);
+    bool changed = false;
+    std::map<std::string, std::string> replaceMap;
+    typedef std::vector<std::pair<std::string, std::string>> AvailVec; /*(地址, 值)*/
+
+    std::function<void(OptBlock *, AvailVec)> visit = [&](OptBlock *block, AvailVec availVec)
+    {
+        auto eraseIf = [&availVec](std::function<bool(const std::string &)> pred)
+        {
+            AvailVec newVec;
+            for (auto &avail : availVec)
+                if (!pred(avail.first))
+                    newVec.push_back(avail);
+            availVec = newVec;
+        };
+
+        std::vector<IRInst> instVec;
+        for (IRInst &inst : block->instVec)
+        {
+            for (std::string *ref : inst.useRefs())
+                if (replaceMap.count(*ref))
+                    *ref = replaceMap[*ref];
+
+            const OptAlias::MemLocation *loc = NULL;
+            if (inst.op == "load")
+                loc = &alias.locate(inst.args[0]);
+            if (loc && loc->kind == OptAlias::ROOT_GLOBAL && readOnlySet.count(loc->root) &&
+                loc->termMap.empty())
+            {
+                /*只读全局变量中常数位置的值直接取初值*/
+                const IRInst *global = NULL;
+                for (const IRInst &elem : globalVec)
+                    if (elem.dest == loc->root)
+                        global = &elem;
+                if (loc->offset >= 0 && loc->offset < IRInst::typeSize(global->type))
+                {
+                    replaceMap[inst.dest] =
+                        IRInst::initElement(global->args[0], global->type, loc->offset);
+                    changed = true;
+                    continue;
+                }
+            }
+            if (inst.op == "load")
+            {
+                bool found = false;
+                for (auto iter = availVec.rbegin(); iter != availVec.rend() && !found; iter++)
+                {
+                    if (alias.alias(inst.args[0], iter->first) != OptAlias::MUST_ALIAS)
+                        continue;
+                    replaceMap[inst.dest] = iter->second;
+                    found = changed = true;
+                }
+                if (found)
+                    continue;
+                availVec.push_back(std::make_pair(inst.args[0], inst.dest));
+            }
+            else if (inst.op == "store")
+            {
+                const std::string &ptr = inst.args[1];
+                bool aggregate = !IRInst::isConst(inst.args[0]) && inst.args[0][0] != '%' &&
+                                 inst.args[0][0] != '@';
+                eraseIf([&](const std::string &p)
+                        { return alias.alias(ptr, p, aggregate) != OptAlias::NO_ALIAS; });
+                if (!aggregate)
+                    availVec.push_back(std::make_pair(ptr, inst.args[0]));
+            }
+            else if (inst.op == "call")
+                eraseIf([&](const std::string &p) { return alias.callMayTouch(inst, p, true); });
+            if (availVec.size() > maxAvailCount)
+                availVec.erase(availVec.begin());
+            instVec.push_back(inst);
+        }
+        block->instVec = instVec;
+
+        for (OptBlock *child : block->domChildVec)
+            visit(child, child->predVec.size() == 1 ? availVec : AvailVec());
+    };
+    visit(func->blockVec.front(), AvailVec());
+    return changed;
+}
+
+bool IROptimizer::eliminateDeadStore(OptFunction *func)
+{
+    static const int maxPostDomDepth = 8;
+
+    func->buildAnalysis();
+    OptAlias alias(func, this);
+    std::set<std::pair<OptBlock *, size_t>> deadSet;
+    auto isAggregate = [](const IRInst &inst)
+    { return !IRInst::isConst(inst.args[0]) && inst.args[0][0] != '%' && inst.args[0][0] != '@'; };
+    auto mayRead = [&alias](IRInst &inst, const std::string &ptr) -> bool
+    {
+        if (inst.op == "load")
+            return alias.alias(inst.args[0], ptr) != OptAlias::NO_ALIAS;
+        if (inst.op == "call")
+            return alias.callMayTouch(inst, ptr, false);
+        return false;
+    };
+
+    /*块内：之后在读之前被同一地址覆盖的 store*/
+    for (OptBlock *block : func->blockVec)
+    {
+        std::vector<std::string> killVec;
+        for (size_t i = block->instVec.size(); i-- > 0;)
+        {
+            IRInst &inst = block->instVec[i];
+            if (inst.op == "store" && isAggregate(inst))
+            {
+                /*聚合初始化的每个元素都被覆盖时整体删除*/
+                const OptAlias::MemLocation &loc = alias.locate(inst.args[1]);
+                int size = IRInst::typeSize(IRInst::elemType(alias.typeMap[inst.args[1]]));
+                std::set<int> coverSet;
+                for (const std::string &kill : killVec)
+                {
+                    const OptAlias::MemLocation &killLoc = alias.locate(kill);
+                    if (killLoc.root == loc.root && killLoc.termMap.empty() && loc.termMap.empty())
+                        coverSet.insert(killLoc.offset - loc.offset);
+                }
+                int covered = 0;
+                for (int k = 0; k < size; k++)
+                    covered += coverSet.count(k);
+                if (covered == size)
+                    deadSet.insert(std::make_pair(block, i));
+            }
+            else if (inst.op == "store")
+            {
+                bool dead = false;
+                for (const std::string &kill : killVec)
+                    dead |= (alias.alias(inst.args[1], kill) == OptAlias::MUST_ALIAS);
+                if (dead)
+                    deadSet.insert(std::make_pair(block, i));
+                else
+                    killVec.push_back(inst.args[1]);
+            }
+            else if (inst.op == "load" || inst.op == "call")
+            {
+                std::vector<std::string> newVec;
+                for (const std::string &kill : killVec)
+                    if (!mayRead(inst, kill))
+                        newVec.push_back(kill);
+                killVec = newVec;
+            }
+        }
+    }
+
+    /*跨块：后支配块中先被同一地址覆盖，途经的块都不读*/
+    std::map<OptBlock *, OptBlock *> ipdom = func->getPostIdom();
+    std::map<std::string, OptBlock *> defBlockMap;
+    for (OptBlock *block : func->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            defBlockMap[param.first] = block;
+        for (IRInst &inst : block->instVec)
+            if (!inst.dest.empty())
+                defBlockMap[inst.dest] = block;
+    }
+    for (OptBlock *block : func->blockVec)
+    {
+        for (size_t i = 0; i < block->instVec.size(); i++)
+        {
+            IRInst &store = block->instVec[i];
+            if (store.op != "store" || isAggregate(store) || deadSet.count(std::make_pair(block, i)))
+                continue;
+            const std::string &ptr = store.args[1];
+            bool blocked = false;
+            for (size_t j = i + 1; j < block->instVec.size() && !blocked; j++)
+                blocked |= mayRead(block->instVec[j], ptr);
+
+            const OptAlias::MemLocation &loc = alias.locate(ptr);
+            std::set<OptBlock *> varDefSet;
+            for (auto &term : loc.termMap)
+                varDefSet.insert(defBlockMap[term.first]);
+            varDefSet.insert(defBlockMap[loc.root]);
+
+            OptBlock *post = block;
+            for (int depth = 0; depth < maxPostDomDepth && !blocked; depth++)
+            {
+                if (!ipdom.count(post) || !ipdom[post])
+                    break;
+                post = ipdom[post];
+
+                /*从 block 到 post 途经的块*/
+                std::set<OptBlock *> regionSet;
+                std::vector<OptBlock *> stack(block->succVec.begin(), block->succVec.end());
+                while (!stack.empty())
+                {
+                    OptBlock *cur = stack.back();
+                    stack.pop_back();
+                    if (cur == post || !regionSet.insert(cur).second)
+                        continue;
+                    stack.insert(stack.end(), cur->succVec.begin(), cur->succVec.end());
+                }
+                if (varDefSet.count(post))
+                    break;
+                for (OptBlock *cur : regionSet)
+                {
+                    blocked |= varDefSet.count(cur) != 0;
+                    for (size_t j = 0; j < cur->instVec.size() && !blocked; j++)
+                        blocked |= (cur != block || j != i) && mayRead(cur->instVec[j], ptr);
+                }
+                if (blocked)
+                    break;
+
+                bool found = false;
+                for (IRInst &inst : post->instVec)
+                {
+                    if (mayRead(inst, ptr))
+                    {
+                        blocked = true;
+                        break;
+                    }
+                    if (inst.op == "store" && !isAggregate(inst) &&
+                        alias.alias(inst.args[1], ptr) == OptAlias::MUST_ALIAS)
+                    {
+                        found = true;
+                        break;
+                    }
+                }
+                if (found)
+                {
+                    deadSet.insert(std::make_pair(block, i));
+                    break;
+                }
+            }
+        }
+    }
+
+    /*未逃逸的局部变量，store 之后再也不会被读*/
+    std::map<std::string, std::set<OptBlock *>> reachLoadMap; /*能到达该变量 load 的块*/
+    for (OptBlock *block : func->blockVec)
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.op != "load")
+                continue;
+            const OptAlias::MemLocation &loc = alias.locate(inst.args[0]);
+            if (loc.kind != OptAlias::ROOT_ALLOC)
+                continue;
+            std::set<OptBlock *> &reachSet = reachLoadMap[loc.root];
+            if (reachSet.count(block))
+                continue;
+            std::vector<OptBlock *> stack(1, block);
+            reachSet.insert(block);
+            while (!stack.empty())
+            {
+                OptBlock *cur = stack.back();
+                stack.pop_back();
+                for (OptBlock *pred : cur->predVec)
+                    if (reachSet.insert(pred).second)
+                        stack.push_back(pred);
+            }
+        }
+    }
+    for (OptBlock *block : func->blockVec)
+    {
+        for (size_t i = 0; i < block->instVec.size(); i++)
+        {
+            IRInst &store = block->instVec[i];
+            if (store.op != "store")
+                continue;
+            const OptAlias::MemLocation &loc = alias.locate(store.args[1]);
+            if (loc.kind != OptAlias::ROOT_ALLOC || alias.escapedSet.count(loc.root))
+                continue;
+            std::set<OptBlock *> &reachSet = reachLoadMap[loc.root];
+            bool read = false;
+            for (OptBlock *succ : block->succVec)
+                read |= reachSet.count(succ) != 0;
+            for (size_t j = i + 1; j < block->instVec.size(); j++)
+            {
+                IRInst &inst = block->instVec[j];
+                read |= inst.op == "load" && alias.locate(inst.args[0]).root == loc.root;
+            }
+            if (!read)
+                deadSet.insert(std::make_pair(block, i));
+        }
+    }
+
+    if (deadSet.empty())
+        return false;
+    for (OptBlock *block : func->blockVec)
+    {
+        std::vector<IRInst> instVec;
+        for (size_t i = 0; i < block->instVec.size(); i++)
+            if (!deadSet.count(std::make_pair(block, i)))
+                instVec.push_back(block->instVec[i]);
+        block->instVec = instVec;
+    }
+    return true;
+}
+
+bool IROptimizer::splitLocalArray(OptFunction *func)
+{
+    /*只用常数下标访问、不逃逸的小局部数组拆成独立的 i32 变量*/
+    static const int maxArraySize = 32;
+
+    OptAlias alias(func, this);
+    std::map<std::string, bool> splitMap;
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            if (inst.op == "alloc" && inst.type[0] == '[' &&
+                IRInst::typeSize(inst.type) <= maxArraySize)
+                splitMap[inst.dest] = !alias.escapedSet.count(inst.dest);
+    if (splitMap.empty())
+        return false;
+
+    auto checkAccess = [&](const std::string &ptr, bool whole)
+    {
+        if (!alias.isPointer(ptr))
+            return;
+        const OptAlias::MemLocation &loc = alias.locate(ptr);
+        if (!splitMap.count(loc.root))
+            return;
+        int size = IRInst::typeSize(alias.defMap[loc.root].type);
+        bool valid = loc.termMap.empty() && loc.offset >= 0 && loc.offset < size;
+        if (whole)
+            valid = (ptr == loc.root);
+        if (!valid)
+            splitMap[loc.root] = false;
+    };
+    for (OptBlock *block : func->blockVec)
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.op == "load")
+                checkAccess(inst.args[0], false);
+            else if (inst.op == "store")
+            {
+                bool aggregate = !IRInst::isConst(inst.args[0]) && inst.args[0][0] != '%' &&
+                                 inst.args[0][0] != '@';
+                checkAccess(inst.args[1], aggregate);
+            }
+            else if (inst.op == "getelemptr" || inst.op == "getptr")
+            {
+                /*下标不是常数时，派生出的指针的偏移会含有变量项*/
+                checkAccess(inst.dest, false);
+            }
+        }
+    }
+
+    std::map<std::string, std::vector<std::string>> scalarMap;
+    for (auto &p : splitMap)
+    {
+        if (!p.second)
+            continue;
+        std::vector<std::string> &scalarVec = scalarMap[p.first];
+        for (int i = 0; i < IRInst::typeSize(alias.defMap[p.first].type); i++)
+            scalarVec.push_back(func->getNextVarIdent());
+    }
+    if (scalarMap.empty())
+        return false;
+
+    for (OptBlock *block : func->blockVec)
+    {
+        std::vector<IRInst> instVec;
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.op == "alloc" && scalarMap.count(inst.dest))
+            {
+                for (const std::string &scalar : scalarMap[inst.dest])
+                {
+                    IRInst allocInst(scalar, std::string("alloc"));
+                    allocInst.type = std::string("i32");
+                    instVec.push_back(allocInst);
+                }
+                continue;
+            }
+            if ((inst.op == "getelemptr" || inst.op == "getptr") &&
+                scalarMap.count(alias.locate(inst.dest).root))
+                continue;
+            std::string *ptr = NULL;
+            if (inst.op == "load")
+                ptr = &inst.args[0];
+            else if (inst.op == "store")
+                ptr = &inst.args[1];
+            if (!ptr || !alias.isPointer(*ptr) || !scalarMap.count(alias.locate(*ptr).root))
+            {
+                instVec.push_back(inst);
+                continue;
+            }
+            const OptAlias::MemLocation &loc = alias.locate(*ptr);
+            std::vector<std::string> &scalarVec = scalarMap[loc.root];
+            if (inst.op == "store" && *ptr == loc.root)
+            {
+                /*聚合初始化拆成逐个元素的 store*/
+                std::vector<std::string> initVec =
+                    IRInst::flattenInit(inst.args[0], alias.defMap[loc.root].type);
+                for (size_t k = 0; k < initVec.size(); k++)
+                    instVec.push_back(
+                        IRInst(std::string(), std::string("store"), {initVec[k], scalarVec[k]}));
+                continue;
+            }
+            *ptr = scalarVec[loc.offset];
+            instVec.push_back(inst);
+        }
+        block->instVec = instVec;
+    }
+    return true;
+}
+
+/* END */
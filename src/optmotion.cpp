@@ -0,0 +1,406 @@
+#include "iroptimizer.hpp"
+#include <algorithm>
+#include <functional>
+
+/*部分冗余消除中的一类表达式：由纯运算、地址计算和 load 组成的一棵小树，叶子为 SSA 值*/
+struct RedundantExpr
+{
+    std::string key;
+    std::set<std::string> leafSet;
+    std::vector<std::string> addrVec; /*树中 load 的地址*/
+    std::vector<std::pair<OptBlock *, std::string>> occurVec;
+};
+
+static bool isTreeOp(const IRInst &inst)
+{
+    return inst.isBinary() || inst.op == "load" || inst.op == "getelemptr" || inst.op == "getptr";
+}
+
+/*懒惰代码移动：在缺少计算的边上插入表达式，删除汇合之后完全冗余的计算，
+  任何路径上的计算次数都不增加。表达式的值经由一个局部变量传递，再由 promoteAlloc 构造 SSA*/
+bool IROptimizer::eliminatePartialRedundancy(OptFunction *func)
+{
+    static const int maxTreeDepth = 3;
+
+    func->buildCFG();
+    OptAlias alias(func, this);
+    std::map<std::string, IRInst> defMap;
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            if (!inst.dest.empty())
+                defMap[inst.dest] = inst;
+
+    /*表达式树的规范形式，交换律运算的两个子树按字典序排列*/
+    std::function<std::string(const std::string &, int, RedundantExpr *)> keyOf =
+        [&](const std::string &value, int depth, RedundantExpr *expr) -> std::string
+    {
+        auto def = defMap.find(value);
+        if (depth >= maxTreeDepth || def == defMap.end() || !isTreeOp(def->second))
+        {
+            if (expr && !IRInst::isConst(value))
+                expr->leafSet.insert(value);
+            return value;
+        }
+        const IRInst &inst = def->second;
+        if (expr && inst.op == "load")
+            expr->addrVec.push_back(inst.args[0]);
+        std::vector<std::string> argVec;
+        for (const std::string &arg : inst.args)
+            argVec.push_back(keyOf(arg, depth + 1, expr));
+        bool commutative = inst.op == "add" || inst.op == "mul" || inst.op == "and" ||
+                           inst.op == "or" || inst.op == "xor" || inst.op == "eq" ||
+                           inst.op == "ne";
+        if (commutative)
+            std::sort(argVec.begin(), argVec.end());
+        std::string key = inst.op + "(";
+        for (const std::string &arg : argVec)
+            key += arg + ",";
+        return key + ")";
+    };
+    std::function<std::string(const std::string &, int, std::vector<IRInst> &)> cloneTree =
+        [&](const std::string &value, int depth, std::vector<IRInst> &codeVec) -> std::string
+    {
+        auto def = defMap.find(value);
+        if (depth >= maxTreeDepth || def == defMap.end() || !isTreeOp(def->second))
+            return value;
+        IRInst inst = def->second;
+        for (std::string &arg : inst.args)
+            arg = cloneTree(arg, depth + 1, codeVec);
+        inst.dest = func->getNextVarIdent();
+        codeVec.push_back(inst);
+        return inst.dest;
+    };
+
+    /*收集出现两次以上、结果为 i32 的表达式*/
+    std::map<std::string, RedundantExpr> exprMap;
+    std::map<std::string, std::string> keyMap;
+    std::vector<std::string> keyVec;
+    for (OptBlock *block : func->blockVec)
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            if (!isTreeOp(inst) || alias.typeMap[inst.dest] != "i32")
+                continue;
+            std::string key = keyMap[inst.dest] = keyOf(inst.dest, 0, NULL);
+            if (!exprMap.count(key))
+            {
+                keyVec.push_back(key);
+                exprMap[key].key = key;
+                keyOf(inst.dest, 0, &exprMap[key]);
+            }
+            exprMap[key].occurVec.push_back(std::make_pair(block, inst.dest));
+        }
+    }
+
+    bool changed = false;
+    std::set<std::string> tmpSet;
+    for (const std::string &key : keyVec)
+    {
+        RedundantExpr &expr = exprMap[key];
+        if (expr.occurVec.size() < 2)
+            continue;
+        std::vector<OptBlock *> rpo = func->getRPO();
+        size_t n = rpo.size();
+        std::map<OptBlock *, size_t> indexMap;
+        for (size_t i = 0; i < n; i++)
+            indexMap[rpo[i]] = i;
+
+        /*指令是否使表达式失效：定义了叶子，或者可能写树中 load 的地址*/
+        auto kills = [&](const IRInst &inst)
+        {
+            if (!inst.dest.empty() && expr.leafSet.count(inst.dest))
+                return true;
+            for (const std::string &addr : expr.addrVec)
+            {
+                if (inst.op == "store" && !tmpSet.count(inst.args[1]) &&
+                    alias.alias(inst.args[1], addr) != OptAlias::NO_ALIAS)
+                    return true;
+                if (inst.op == "call" && alias.callMayTouch(inst, addr, true))
+                    return true;
+            }
+            return false;
+        };
+        auto matches = [&](const IRInst &inst)
+        {
+            auto iter = keyMap.find(inst.dest);
+            return isTreeOp(inst) && iter != keyMap.end() && iter->second == key;
+        };
+
+        /*局部性质：ANTLOC 为块内向上暴露，COMP 为块内向下暴露，TRANSP 为块内不失效*/
+        std::vector<char> antloc(n, 0), comp(n, 0), transp(n, 1);
+        for (size_t b = 0; b < n; b++)
+        {
+            for (auto &param : rpo[b]->paramVec)
+                if (expr.leafSet.count(param.first))
+                    transp[b] = 0;
+            for (IRInst &inst : rpo[b]->instVec)
+            {
+                if (matches(inst))
+                {
+                    antloc[b] |= transp[b];
+                    comp[b] = 1;
+                }
+                if (kills(inst))
+                    transp[b] = comp[b] = 0;
+            }
+        }
+
+        /*可用性与预期性*/
+        std::vector<char> avout(n, 1), antin(n, 1), antout(n, 1);
+        bool iterate = true;
+        while (iterate)
+        {
+            iterate = false;
+            for (size_t b = 0; b < n; b++)
+            {
+                char avin = b > 0;
+                for (OptBlock *pred : rpo[b]->predVec)
+                    avin &= avout[indexMap[pred]];
+                char out = comp[b] | (avin & transp[b]);
+                iterate |= out != avout[b];
+                avout[b] = out;
+            }
+        }
+        iterate = true;
+        while (iterate)
+        {
+            iterate = false;
+            for (size_t b = n; b-- > 0;)
+            {
+                char out = !rpo[b]->succVec.empty();
+                for (OptBlock *succ : rpo[b]->succVec)
+                    out &= antin[indexMap[succ]];
+                char in = antloc[b] | (out & transp[b]);
+                iterate |= in != antin[b] || out != antout[b];
+                antin[b] = in;
+                antout[b] = out;
+            }
+        }
+
+        /*EARLIEST 与 LATER 定义在边上，入口视为有一条来自虚拟起点的边*/
+        auto earliest = [&](size_t p, size_t s)
+        { return antin[s] && !avout[p] && (!transp[p] || !antout[p]); };
+        std::vector<char> laterin(n, 1);
+        laterin[0] = antin[0];
+        iterate = true;
+        while (iterate)
+        {
+            iterate = false;
+            for (size_t b = 1; b < n; b++)
+            {
+                char in = 1;
+                for (OptBlock *pred : rpo[b]->predVec)
+                {
+                    size_t p = indexMap[pred];
+                    in &= earliest(p, b) || (laterin[p] && !antloc[p]);
+                }
+                iterate |= in != laterin[b];
+                laterin[b] = in;
+            }
+        }
+
+        bool redundant = false;
+        for (size_t b = 0; b < n; b++)
+        {
+            bool avail = antloc[b] && !laterin[b];
+            for (IRInst &inst : rpo[b]->instVec)
+            {
+                redundant |= avail && matches(inst);
+                avail = (avail || matches(inst)) && !kills(inst);
+            }
+        }
+        if (!redundant)
+            continue;
+
+        /*插入点：LATER(p, s) 且 s 入口处不再推迟*/
+        std::vector<std::pair<OptBlock *, size_t>> insertVec;
+        for (size_t p = 0; p < n; p++)
+        {
+            IRInst &term = rpo[p]->terminator();
+            for (size_t i = 0; i < term.labels.size(); i++)
+            {
+                size_t s = indexMap[func->findBlock(term.labels[i])];
+                bool later = earliest(p, s) || (laterin[p] && !antloc[p]);
+                if (later && !laterin[s])
+                    insertVec.push_back(std::make_pair(rpo[p], i));
+            }
+        }
+
+        /*表达式的值存入局部变量，冗余的计算改为读取*/
+        std::string tmp = func->getNextVarIdent();
+        IRInst allocInst(tmp, std::string("alloc"));
+        allocInst.type = "i32";
+        tmpSet.insert(tmp);
+        const std::string &sample = expr.occurVec.front().second;
+        for (size_t b = 0; b < n; b++)
+        {
+            bool avail = antloc[b] && !laterin[b];
+            std::vector<IRInst> instVec;
+            for (IRInst &inst : rpo[b]->instVec)
+            {
+                bool match = matches(inst);
+                if (match && avail)
+                    instVec.push_back(IRInst(inst.dest, "load", {tmp}));
+                else
+                    instVec.push_back(inst);
+                if (match && !avail)
+                    instVec.push_back(IRInst(std::string(), "store", {inst.dest, tmp}));
+                avail = (avail || match) && !kills(inst);
+            }
+            rpo[b]->instVec = instVec;
+        }
+        for (auto &edge : insertVec)
+        {
+            OptBlock *pred = edge.first;
+            OptBlock *succ = func->findBlock(pred->terminator().labels[edge.second]);
+            std::vector<IRInst> codeVec;
+            std::string value = cloneTree(sample, 0, codeVec);
+            codeVec.push_back(IRInst(std::string(), "store", {value, tmp}));
+            if (pred->succVec.size() == 1)
+                pred->instVec.insert(pred->instVec.end() - 1, codeVec.begin(), codeVec.end());
+            else if (succ->predVec.size() == 1)
+                succ->instVec.insert(succ->instVec.begin(), codeVec.begin(), codeVec.end());
+            else
+            {
+                OptBlock *block = func->splitEdge(pred, edge.second);
+                block->instVec.insert(block->instVec.begin(), codeVec.begin(), codeVec.end());
+            }
+        }
+        OptBlock *entry = func->blockVec.front();
+        entry->instVec.insert(entry->instVec.begin(), allocInst);
+        func->buildCFG();
+        changed = true;
+    }
+    if (changed)
+        promoteAlloc(func);
+    return changed;
+}
+
+/*可以自由移动的指令：除数可能为 0 的除法和取模留在原处*/
+static bool isMovable(const IRInst &inst)
+{
+    if (inst.op == "getelemptr" || inst.op == "getptr")
+        return true;
+    if (!inst.isBinary())
+        return false;
+    if (inst.op == "div" || inst.op == "mod")
+        return IRInst::isConst(inst.args[1]) && IRInst::constValue(inst.args[1]) != 0;
+    return true;
+}
+
+/*Click 的全局代码移动：纯指令先求最早位置，再在最早与最晚位置之间的支配链上
+  选循环嵌套最浅、最靠后的块，把只在分支中使用的计算沉到分支里*/
+bool IROptimizer::moveGlobalCode(OptFunction *func)
+{
+    func->buildAnalysis();
+    OptBlock *entry = func->blockVec.front();
+    std::map<std::string, OptBlock *> defBlockMap;
+    std::map<std::string, IRInst> pureMap;
+    std::vector<std::string> pureVec;
+    std::map<std::string, std::vector<std::pair<std::string, OptBlock *>>> userMap;
+    for (OptBlock *block : func->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            defBlockMap[param.first] = block;
+        for (IRInst &inst : block->instVec)
+        {
+            bool movable = isMovable(inst);
+            for (const std::string &value : inst.uses())
+                userMap[value].push_back(std::make_pair(movable ? inst.dest : "", block));
+            if (inst.dest.empty())
+                continue;
+            defBlockMap[inst.dest] = block;
+            if (!movable)
+                continue;
+            pureMap[inst.dest] = inst;
+            pureVec.push_back(inst.dest);
+        }
+    }
+
+    /*最早位置：所有操作数定义块中支配树最深的一个*/
+    std::map<std::string, OptBlock *> earlyMap;
+    std::function<OptBlock *(const std::string &)> scheduleEarly = [&](const std::string &value)
+    {
+        if (earlyMap.count(value))
+            return earlyMap[value];
+        OptBlock *early = entry;
+        for (const std::string &arg : pureMap[value].args)
+        {
+            OptBlock *block = entry;
+            if (pureMap.count(arg))
+                block = scheduleEarly(arg);
+            else if (defBlockMap.count(arg))
+                block = defBlockMap[arg];
+            if (block->domDepth > early->domDepth)
+                early = block;
+        }
+        return earlyMap[value] = early;
+    };
+
+    /*最晚位置为所有使用块的最近公共支配者，再沿支配链向上找循环最浅的块*/
+    auto commonDominator = [](OptBlock *a, OptBlock *b)
+    {
+        if (!a)
+            return b;
+        while (a != b)
+        {
+            if (a->domDepth < b->domDepth)
+                std::swap(a, b);
+            a = a->idom;
+        }
+        return a;
+    };
+    std::map<std::string, OptBlock *> placeMap;
+    std::function<OptBlock *(const std::string &)> scheduleLate = [&](const std::string &value)
+    {
+        if (placeMap.count(value))
+            return placeMap[value];
+        OptBlock *late = NULL;
+        for (auto &user : userMap[value])
+            late = commonDominator(late, user.first.empty() ? user.second
+                                                            : scheduleLate(user.first));
+        if (!late)
+            return placeMap[value] = defBlockMap[value];
+        OptBlock *early = scheduleEarly(value), *best = late;
+        for (OptBlock *block = late; block != early; block = block->idom)
+            if (block->idom->loopDepth() < best->loopDepth())
+                best = block->idom;
+        return placeMap[value] = best;
+    };
+
+    bool changed = false;
+    for (const std::string &value : pureVec)
+        changed |= scheduleLate(value) != defBlockMap[value];
+    if (!changed)
+        return false;
+
+    /*重排各块：固定的指令保持原顺序，移入的纯指令紧挨在块内第一个使用之前*/
+    std::set<std::string> emitted;
+    for (OptBlock *block : func->blockVec)
+    {
+        std::vector<IRInst> instVec;
+        std::function<void(const std::string &)> emit = [&](const std::string &value)
+        {
+            if (!pureMap.count(value) || placeMap[value] != block || !emitted.insert(value).second)
+                return;
+            for (const std::string &arg : pureMap[value].args)
+                emit(arg);
+            instVec.push_back(pureMap[value]);
+        };
+        for (IRInst &inst : block->instVec)
+        {
+            if (pureMap.count(inst.dest))
+                continue;
+            if (inst.isTerminator())
+                for (const std::string &value : pureVec)
+                    emit(value);
+            for (const std::string &value : inst.uses())
+                emit(value);
+            instVec.push_back(inst);
+        }
+        block->instVec = instVec;
+    }
+    return true;
+}
+
+/* END */
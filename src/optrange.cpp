@@ -0,0 +1,329 @@
+#include "iroptimizer.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+typedef OptRange::Interval Interval;
+
+static const Interval emptyRange = {1, 0};
+static const Interval fullRange = {INT_MIN, INT_MAX};
+
+static bool isEmpty(const Interval &a) { return a.lo > a.hi; }
+
+static Interval join(const Interval &a, const Interval &b)
+{
+    if (isEmpty(a))
+        return b;
+    if (isEmpty(b))
+        return a;
+    return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+static Interval meet(const Interval &a, const Interval &b)
+{
+    return {std::max(a.lo, b.lo), std::min(a.hi, b.hi)};
+}
+
+/*超出 32 位的结果会回绕，只能取整个范围*/
+static Interval clamp(long long lo, long long hi)
+{
+    if (lo < INT_MIN || hi > INT_MAX)
+        return fullRange;
+    return {lo, hi};
+}
+
+static long long magnitude(const Interval &a)
+{
+    return std::max(std::llabs(a.lo), std::llabs(a.hi));
+}
+
+/*比较的结果：确定为真、确定为假或两者皆有可能*/
+static Interval compare(const std::string &op, const Interval &a, const Interval &b)
+{
+    bool canTrue, canFalse;
+    if (op == "lt")
+        canTrue = a.lo < b.hi, canFalse = a.hi >= b.lo;
+    else if (op == "le")
+        canTrue = a.lo <= b.hi, canFalse = a.hi > b.lo;
+    else if (op == "gt")
+        canTrue = a.hi > b.lo, canFalse = a.lo <= b.hi;
+    else if (op == "ge")
+        canTrue = a.hi >= b.lo, canFalse = a.lo < b.hi;
+    else
+    {
+        bool single = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+        bool overlap = a.lo <= b.hi && b.lo <= a.hi;
+        canTrue = (op == "eq") ? overlap : !single;
+        canFalse = (op == "eq") ? !single : overlap;
+    }
+    return {canFalse ? 0 : 1, canTrue ? 1 : 0};
+}
+
+static Interval evalBinary(const std::string &op, const Interval &a, const Interval &b)
+{
+    if (isEmpty(a) || isEmpty(b))
+        return emptyRange;
+    if (op == "lt" || op == "le" || op == "gt" || op == "ge" || op == "eq" || op == "ne")
+        return compare(op, a, b);
+    if (op == "add")
+        return clamp(a.lo + b.lo, a.hi + b.hi);
+    if (op == "sub")
+        return clamp(a.lo - b.hi, a.hi - b.lo);
+    if (op == "mul")
+    {
+        /*两个 32 位数的积不超过 long long*/
+        long long p[] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+        return clamp(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+    }
+    if (op == "div")
+    {
+        if (b.lo == b.hi && b.lo != 0 && !(b.lo == -1 && a.lo == INT_MIN))
+        {
+            long long x = a.lo / b.lo, y = a.hi / b.lo;
+            return {std::min(x, y), std::max(x, y)};
+        }
+        if (a.lo >= 0 && b.lo > 0)
+            return {0, a.hi};
+        return fullRange;
+    }
+    if (op == "mod")
+    {
+        /*余数的符号与被除数相同，绝对值小于除数*/
+        long long bound = magnitude(b) - 1;
+        if (bound < 0)
+            return fullRange;
+        if (a.lo >= 0)
+            return {0, std::min(a.hi, bound)};
+        if (a.hi <= 0)
+            return {std::max(a.lo, -bound), 0};
+        return {-bound, bound};
+    }
+    if (op == "and")
+    {
+        if (a.lo >= 0 && b.lo >= 0)
+            return {0, std::min(a.hi, b.hi)};
+        if (a.lo >= 0 || b.lo >= 0)
+            return {0, a.lo >= 0 ? a.hi : b.hi};
+        return fullRange;
+    }
+    if (op == "or" || op == "xor")
+    {
+        if (a.lo < 0 || b.lo < 0)
+            return fullRange;
+        long long high = 1;
+        while (high <= std::max(a.hi, b.hi))
+            high <<= 1;
+        return {0, high - 1};
+    }
+    if (b.lo != b.hi || b.lo < 0 || b.lo > 31)
+        return fullRange;
+    int shift = (int)b.lo;
+    if (op == "shl")
+        return clamp(a.lo * (1LL << shift), a.hi * (1LL << shift));
+    if (op == "sar")
+        return {a.lo >> shift, a.hi >> shift};
+    if (op == "shr")
+    {
+        if (a.lo >= 0)
+            return {a.lo >> shift, a.hi >> shift};
+        return shift == 0 ? fullRange : Interval{0, (long long)(UINT_MAX >> shift)};
+    }
+    return fullRange;
+}
+
+OptRange::OptRange(OptFunction *func_) : func(func_), defMap(), rangeMap()
+{
+    static const int widenRound = 2;
+    static const int narrowRound = 2;
+
+    /*函数内定义的值从空区间开始，其余的值（函数参数等）取整个范围*/
+    for (OptBlock *block : func->blockVec)
+    {
+        for (auto &param : block->paramVec)
+            rangeMap[param.first] = emptyRange;
+        for (IRInst &inst : block->instVec)
+        {
+            if (inst.dest.empty())
+                continue;
+            defMap[inst.dest] = &inst;
+            rangeMap[inst.dest] = emptyRange;
+        }
+    }
+
+    /*按逆后序迭代到不动点，循环头参数多次变化后放宽到边界，再收紧两轮*/
+    std::vector<OptBlock *> rpo = func->getRPO();
+    bool changed = true;
+    for (int round = 0; changed; round++)
+    {
+        changed = false;
+        for (OptBlock *block : rpo)
+        {
+            for (size_t j = 0; j < block->paramVec.size(); j++)
+            {
+                const std::string &param = block->paramVec[j].first;
+                Interval old = rangeMap[param];
+                Interval range = join(old, paramRange(block, j));
+                if (round >= widenRound && !isEmpty(old))
+                {
+                    if (range.lo < old.lo)
+                        range.lo = INT_MIN;
+                    if (range.hi > old.hi)
+                        range.hi = INT_MAX;
+                }
+                if (range.lo != old.lo || range.hi != old.hi)
+                    changed = true;
+                rangeMap[param] = range;
+            }
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.dest.empty())
+                    continue;
+                Interval old = rangeMap[inst.dest];
+                Interval range = evalInst(inst, block);
+                if (range.lo != old.lo || range.hi != old.hi)
+                    changed = true;
+                rangeMap[inst.dest] = range;
+            }
+        }
+    }
+    for (int round = 0; round < narrowRound; round++)
+    {
+        for (OptBlock *block : rpo)
+        {
+            for (size_t j = 0; j < block->paramVec.size(); j++)
+                rangeMap[block->paramVec[j].first] = paramRange(block, j);
+            for (IRInst &inst : block->instVec)
+                if (!inst.dest.empty())
+                    rangeMap[inst.dest] = evalInst(inst, block);
+        }
+    }
+}
+
+OptRange::Interval OptRange::getRange(const std::string &value, OptBlock *block)
+{
+    static const int maxDepth = 32;
+    if (IRInst::isConst(value))
+        return {IRInst::constValue(value), IRInst::constValue(value)};
+    auto iter = rangeMap.find(value);
+    Interval range = (iter == rangeMap.end()) ? fullRange : iter->second;
+
+    /*沿支配树向上，用支配 block 的分支边收窄*/
+    OptBlock *cur = block;
+    for (int depth = 0; depth < maxDepth && cur && !isEmpty(range); depth++)
+    {
+        if (cur->predVec.size() == 1)
+        {
+            IRInst &term = cur->predVec[0]->terminator();
+            if (term.op == "br" && term.labels[0] != term.labels[1])
+                refine(value, term.args[0], term.labels[0] == cur->blockName, range, 0);
+        }
+        if (cur->idom == cur)
+            break;
+        cur = cur->idom;
+    }
+    return range;
+}
+
+bool OptRange::decide(const std::string &cond, OptBlock *block, bool &result)
+{
+    Interval range = getRange(cond, block);
+    if (isEmpty(range) || (range.lo <= 0 && range.hi >= 0 && range.lo != range.hi))
+        return false;
+    result = !(range.lo == 0 && range.hi == 0);
+    return true;
+}
+
+OptRange::Interval OptRange::paramRange(OptBlock *block, size_t index)
+{
+    Interval range = emptyRange;
+    for (OptBlock *pred : block->predVec)
+    {
+        IRInst &term = pred->terminator();
+        for (size_t i = 0; i < term.labels.size(); i++)
+        {
+            if (term.labels[i] != block->blockName)
+                continue;
+            const std::string &arg = term.labelArgs[i][index];
+            Interval argRange = getRange(arg, pred);
+            if (term.op == "br" && term.labels[0] != term.labels[1])
+                refine(arg, term.args[0], i == 0, argRange, 0);
+            range = join(range, argRange);
+        }
+    }
+    return range;
+}
+
+OptRange::Interval OptRange::evalInst(const IRInst &inst, OptBlock *block)
+{
+    if (!inst.isBinary())
+        return fullRange;
+    return evalBinary(inst.op, getRange(inst.args[0], block), getRange(inst.args[1], block));
+}
+
+void OptRange::refine(const std::string &value, const std::string &cond, bool taken,
+                      Interval &range, int depth)
+{
+    static const int maxDepth = 4;
+    static const std::map<std::string, std::string> swapMap = {
+        {"lt", "gt"}, {"gt", "lt"}, {"le", "ge"}, {"ge", "le"}, {"eq", "eq"}, {"ne", "ne"}};
+    static const std::map<std::string, std::string> notMap = {
+        {"lt", "ge"}, {"ge", "lt"}, {"le", "gt"}, {"gt", "le"}, {"eq", "ne"}, {"ne", "eq"}};
+
+    if (cond == value)
+    {
+        if (!taken)
+            range = meet(range, {0, 0});
+        else if (range.lo == 0)
+            range.lo = 1;
+        else if (range.hi == 0)
+            range.hi = -1;
+        return;
+    }
+    auto def = defMap.find(cond);
+    if (depth >= maxDepth || def == defMap.end() || !swapMap.count(def->second->op))
+        return;
+    const IRInst &inst = *def->second;
+
+    /*t != 0 与 t == 0 继续看 t 本身的条件*/
+    if ((inst.op == "ne" || inst.op == "eq") && (inst.args[0] == "0" || inst.args[1] == "0"))
+    {
+        const std::string &inner = inst.args[0] == "0" ? inst.args[1] : inst.args[0];
+        if (inner != value)
+            refine(value, inner, inst.op == "ne" ? taken : !taken, range, depth + 1);
+    }
+
+    std::string op = inst.op, other;
+    if (inst.args[0] == value)
+        other = inst.args[1];
+    else if (inst.args[1] == value)
+    {
+        other = inst.args[0];
+        op = swapMap.at(op);
+    }
+    else
+        return;
+    if (!taken)
+        op = notMap.at(op);
+    Interval bound = fullRange;
+    if (IRInst::isConst(other))
+        bound = {IRInst::constValue(other), IRInst::constValue(other)};
+    else if (rangeMap.count(other) && !isEmpty(rangeMap[other]))
+        bound = rangeMap[other];
+
+    if (op == "lt")
+        range.hi = std::min(range.hi, bound.hi - 1);
+    else if (op == "le")
+        range.hi = std::min(range.hi, bound.hi);
+    else if (op == "gt")
+        range.lo = std::max(range.lo, bound.lo + 1);
+    else if (op == "ge")
+        range.lo = std::max(range.lo, bound.lo);
+    else if (op == "eq")
+        range = meet(range, bound);
+    else if (bound.lo == bound.hi && range.lo == bound.lo)
+        range.lo++;
+    else if (bound.lo == bound.hi && range.hi == bound.lo)
+        range.hi--;
+}
+
+/* END */
@@ -0,0 +1,1007 @@
+#include "iroptimizer.hpp"
+#include <algorithm>
+#include <climits>
+#include <functional>
+
+/*计算两个常数的二元运算，不能折叠时返回 false*/
+bool IRInst::evalBinary(const std::string &op, int lhs, int rhs, int &res)
+{
+    long long a = lhs, b = rhs;
+    if (op == "ne")
+        res = (a != b);
+    else if (op == "eq")
+        res = (a == b);
+    else if (op == "gt")
+        res = (a > b);
+    else if (op == "lt")
+        res = (a < b);
+    else if (op == "ge")
+        res = (a >= b);
+    else if (op == "le")
+        res = (a <= b);
+    else if (op == "add")
+        res = (int)(unsigned)(a + b);
+    else if (op == "sub")
+        res = (int)(unsigned)(a - b);
+    else if (op == "mul")
+        res = (int)((unsigned)lhs * (unsigned)rhs);
+    else if (op == "div" || op == "mod")
+    {
+        if (rhs == 0 || (lhs == INT_MIN && rhs == -1))
+            return false;
+        res = (op == "div") ? lhs / rhs : lhs % rhs;
+    }
+    else if (op == "and")
+        res = lhs & rhs;
+    else if (op == "or")
+        res = lhs | rhs;
+    else if (op == "xor")
+        res = lhs ^ rhs;
+    else if (op == "shl")
+        res = (int)((unsigned)lhs << (rhs & 31));
+    else if (op == "shr")
+        res = (int)((unsigned)lhs >> (rhs & 31));
+    else if (op == "sar")
+        res = lhs >> (rhs & 31);
+    else
+        return false;
+    return true;
+}
+
+bool IROptimizer::foldConstant(OptFunction *func)
+{
+    bool changed = false;
+    std::map<std::string, std::string> constMap;
+    for (OptBlock *block : func->getRPO())
+    {
+        std::vector<IRInst> instVec;
+        for (IRInst &inst : block->instVec)
+        {
+            for (std::string *ref : inst.useRefs())
+                if (constMap.count(*ref))
+                    *ref = constMap[*ref];
+
+            int res;
+            if (inst.isBinary() && IRInst::isConst(inst.args[0]) &&
+                IRInst::isConst(inst.args[1]) &&
+                IRInst::evalBinary(inst.op, IRInst::constValue(inst.args[0]),
+                                   IRInst::constValue(inst.args[1]), res))
+            {
+                constMap[inst.dest] = std::to_string(res);
+                changed = true;
+                continue;
+            }
+
+            /*条件为常数的分支改为跳转*/
+            if (inst.op == "br" && IRInst::isConst(inst.args[0]))
+            {
+                int taken = IRInst::constValue(inst.args[0]) ? 0 : 1;
+                IRInst jumpInst(std::string(), std::string("jump"));
+                jumpInst.labels.push_back(inst.labels[taken]);
+                jumpInst.labelArgs.push_back(inst.labelArgs[taken]);
+                instVec.push_back(jumpInst);
+                changed = true;
+                continue;
+            }
+            instVec.push_back(inst);
+        }
+        block->instVec = instVec;
+    }
+    if (changed)
+        func->buildCFG();
+    return changed;
+}
+
+bool IROptimizer::simplifyCFG(OptFunction *func)
+{
+    bool changed = false;
+    func->buildCFG();
+
+    /*两个目标相同的分支改为跳转*/
+    for (OptBlock *block : func->blockVec)
+    {
+        IRInst &term = block->terminator();
+        if (term.op != "br" || term.labels[0] != term.labels[1] ||
+            term.labelArgs[0] != term.labelArgs[1])
+            continue;
+        IRInst jumpInst(std::string(), std::string("jump"));
+        jumpInst.labels.push_back(term.labels[0]);
+        jumpInst.labelArgs.push_back(term.labelArgs[0]);
+        term = jumpInst;
+        changed = true;
+    }
+    if (changed)
+        func->buildCFG();
+
+    /*只含一条无参跳转的块，把前驱直接连到它的目标*/
+    for (OptBlock *block : func->blockVec)
+    {
+        if (block == func->blockVec.front() || block->instVec.size() != 1 ||
+            !block->paramVec.empty())
+            continue;
+        IRInst &term = block->terminator();
+        if (term.op != "jump" || term.labels[0] == block->blockName)
+            continue;
+        bool forwarded = false;
+        for (OptBlock *pred : block->predVec)
+        {
+            IRInst &predTerm = pred->terminator();
+            for (size_t i = 0; i < predTerm.labels.size(); i++)
+            {
+                if (predTerm.labels[i] != block->blockName)
+                    continue;
+                predTerm.labels[i] = term.labels[0];
+                predTerm.labelArgs[i] = term.labelArgs[0];
+                forwarded = true;
+            }
+        }
+        if (forwarded)
+        {
+            func->buildCFG();
+            changed = true;
+            break;
+        }
+    }
+
+    /*唯一前驱以 jump 进入的块并入前驱*/
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (OptBlock *block : func->blockVec)
+        {
+            if (block->succVec.size() != 1)
+                continue;
+            OptBlock *succ = block->succVec[0];
+            if (succ == block || succ == func->blockVec.front() || succ->predVec.size() != 1)
+                continue;
+            IRInst term = block->terminator();
+            block->instVec.pop_back();
+            /*块参数直接替换为跳转传入的值*/
+            for (size_t i = 0; i < succ->paramVec.size(); i++)
+                func->replaceAllUses(succ->paramVec[i].first, term.labelArgs[0][i]);
+            block->instVec.insert(block->instVec.end(), succ->instVec.begin(),
+                                  succ->instVec.end());
+            auto &blockVec = func->blockVec;
+            blockVec.erase(std::find(blockVec.begin(), blockVec.end(), succ));
+            delete succ;
+            func->buildCFG();
+            merged = changed = true;
+            break;
+        }
+    }
+    return changed;
+}
+
+bool IROptimizer::simplifyBlockParam(OptFunction *func)
+{
+    /*所有前驱传入同一个值的块参数，直接替换为该值*/
+    bool changed = false;
+    func->buildCFG();
+    for (OptBlock *block : func->blockVec)
+    {
+        for (size_t j = 0; j < block->paramVec.size();)
+        {
+            const std::string &param = block->paramVec[j].first;
+            std::set<std::string> valueSet;
+            for (OptBlock *pred : block->predVec)
+            {
+                IRInst &term = pred->terminator();
+                for (size_t i = 0; i < term.labels.size(); i++)
+                    if (term.labels[i] == block->blockName && term.labelArgs[i][j] != param)
+                        valueSet.insert(term.labelArgs[i][j]);
+            }
+            if (valueSet.size() > 1)
+            {
+                j++;
+                continue;
+            }
+            std::string value = valueSet.empty() ? std::string("0") : *valueSet.begin();
+            func->replaceAllUses(std::string(param), value);
+            func->removeBlockParam(block, j);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool IROptimizer::eliminateDeadCode(OptFunction *func)
+{
+    /*从有副作用的指令出发标记活跃值，删除其余无副作用的指令和块参数*/
+    func->buildCFG();
+    std::map<std::string, IRInst *> defMap;
+    std::map<std::string, std::pair<OptBlock *, size_t>> paramMap;
+    for (OptBlock *block : func->blockVec)
+    {
+        for (size_t j = 0; j < block->paramVec.size(); j++)
+            paramMap[block->paramVec[j].first] = std::make_pair(block, j);
+        for (IRInst &inst : block->instVec)
+            if (!inst.dest.empty())
+                defMap[inst.dest] = &inst;
+    }
+
+    std::set<std::string> liveSet;
+    std::vector<std::string> worklist;
+    auto markLive = [&liveSet, &worklist](const std::string &value)
+    {
+        if (liveSet.insert(value).second)
+            worklist.push_back(value);
+    };
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            if (inst.hasSideEffect())
+                for (const std::string &arg : inst.args)
+                    markLive(arg);
+    while (!worklist.empty())
+    {
+        std::string value = worklist.back();
+        worklist.pop_back();
+        if (defMap.count(value))
+        {
+            for (const std::string &arg : defMap[value]->args)
+                markLive(arg);
+            continue;
+        }
+        if (!paramMap.count(value))
+            continue;
+        OptBlock *block = paramMap[value].first;
+        size_t j = paramMap[value].second;
+        for (OptBlock *pred : block->predVec)
+        {
+            IRInst &term = pred->terminator();
+            for (size_t i = 0; i < term.labels.size(); i++)
+                if (term.labels[i] == block->blockName)
+                    markLive(term.labelArgs[i][j]);
+        }
+    }
+
+    bool changed = false;
+    for (OptBlock *block : func->blockVec)
+    {
+        std::vector<IRInst> instVec;
+        for (IRInst &inst : block->instVec)
+            if (inst.hasSideEffect() || liveSet.count(inst.dest))
+                instVec.push_back(inst);
+        changed |= (instVec.size() != block->instVec.size());
+        block->instVec = instVec;
+        for (size_t j = block->paramVec.size(); j-- > 0;)
+        {
+            if (liveSet.count(block->paramVec[j].first))
+                continue;
+            func->removeBlockParam(block, j);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/*分支条件给出的事实：已知非零的值，以及已知的取值区间*/
+struct BranchFacts
+{
+    std::set<std::string> nonzeroSet;
+    std::map<std::string, std::pair<long long, long long>> rangeMap;
+};
+
+typedef std::function<const IRInst *(const std::string &)> DefLookup;
+
+static const std::map<std::string, std::string> swapCmpMap = {
+    {"lt", "gt"}, {"gt", "lt"}, {"le", "ge"}, {"ge", "le"}, {"eq", "eq"}, {"ne", "ne"}};
+static const std::map<std::string, std::string> notCmpMap = {
+    {"lt", "ge"}, {"ge", "lt"}, {"le", "gt"}, {"gt", "le"}, {"eq", "ne"}, {"ne", "eq"}};
+
+static void restrictRange(BranchFacts &facts, const std::string &value, long long lo, long long hi)
+{
+    auto iter = facts.rangeMap.find(value);
+    if (iter == facts.rangeMap.end())
+        facts.rangeMap[value] = std::make_pair(lo, hi);
+    else
+        iter->second = std::make_pair(std::max(lo, iter->second.first),
+                                      std::min(hi, iter->second.second));
+}
+
+/*把比较统一为 x op k 的形式，k 为常数*/
+static bool splitCompare(const IRInst *def, std::string &op, std::string &x, long long &k)
+{
+    if (!def || !swapCmpMap.count(def->op))
+        return false;
+    op = def->op;
+    if (IRInst::isConst(def->args[1]) && !IRInst::isConst(def->args[0]))
+    {
+        x = def->args[0];
+        k = IRInst::constValue(def->args[1]);
+    }
+    else if (IRInst::isConst(def->args[0]) && !IRInst::isConst(def->args[1]))
+    {
+        x = def->args[1];
+        k = IRInst::constValue(def->args[0]);
+        op = swapCmpMap.at(op);
+    }
+    else
+        return false;
+    return true;
+}
+
+/*记录分支条件 cond 取 taken 时成立的事实*/
+static void addFact(const DefLookup &lookup, const std::string &cond, bool taken,
+                    BranchFacts &facts)
+{
+    if (taken)
+        facts.nonzeroSet.insert(cond);
+    else
+        restrictRange(facts, cond, 0, 0);
+    std::string op, x;
+    long long k;
+    if (!splitCompare(lookup(cond), op, x, k))
+        return;
+    if (!taken)
+        op = notCmpMap.at(op);
+    if (op == "lt")
+        restrictRange(facts, x, INT_MIN, k - 1);
+    else if (op == "le")
+        restrictRange(facts, x, INT_MIN, k);
+    else if (op == "gt")
+        restrictRange(facts, x, k + 1, INT_MAX);
+    else if (op == "ge")
+        restrictRange(facts, x, k, INT_MAX);
+    else if (op == "eq")
+        restrictRange(facts, x, k, k);
+    else if (k == 0)
+        facts.nonzeroSet.insert(x);
+}
+
+/*沿唯一前驱链向上收集支配 block 的分支事实*/
+static void collectFacts(const DefLookup &lookup, OptBlock *block, BranchFacts &facts)
+{
+    static const int maxDepth = 8;
+    OptBlock *cur = block;
+    for (int depth = 0; depth < maxDepth && cur->predVec.size() == 1; depth++)
+    {
+        OptBlock *pred = cur->predVec[0];
+        IRInst &term = pred->terminator();
+        if (term.op == "br" && term.labels[0] != term.labels[1])
+            addFact(lookup, term.args[0], term.labels[0] == cur->blockName, facts);
+        cur = pred;
+        if (cur == block)
+            break;
+    }
+}
+
+/*由已知事实判定条件的真假*/
+static bool decideCond(const DefLookup &lookup, const std::string &cond, const BranchFacts &facts,
+                       bool &result)
+{
+    if (IRInst::isConst(cond))
+    {
+        result = IRInst::constValue(cond) != 0;
+        return true;
+    }
+    if (facts.nonzeroSet.count(cond))
+    {
+        result = true;
+        return true;
+    }
+    auto condRange = facts.rangeMap.find(cond);
+    if (condRange != facts.rangeMap.end() && condRange->second == std::make_pair(0LL, 0LL))
+    {
+        result = false;
+        return true;
+    }
+
+    std::string op, x;
+    long long k;
+    if (!splitCompare(lookup(cond), op, x, k))
+        return false;
+    auto xRange = facts.rangeMap.find(x);
+    long long lo = INT_MIN, hi = INT_MAX;
+    if (xRange != facts.rangeMap.end())
+    {
+        lo = xRange->second.first;
+        hi = xRange->second.second;
+    }
+    /*x 与 0 比较相等与否时，递归判定 x 本身*/
+    bool inner;
+    if (k == 0 && (op == "eq" || op == "ne") && decideCond(lookup, x, facts, inner))
+    {
+        result = (op == "ne") ? inner : !inner;
+        return true;
+    }
+    /*区间内全部满足或全部不满足时结果确定*/
+    bool all, none;
+    if (op == "lt")
+        all = hi < k, none = lo >= k;
+    else if (op == "le")
+        all = hi <= k, none = lo > k;
+    else if (op == "gt")
+        all = lo > k, none = hi <= k;
+    else if (op == "ge")
+        all = lo >= k, none = hi < k;
+    else
+    {
+        bool equal = (lo == k && hi == k), differ = (k < lo || k > hi);
+        all = (op == "eq") ? equal : differ;
+        none = (op == "eq") ? differ : equal;
+    }
+    if (!all && !none)
+        return false;
+    result = all;
+    return true;
+}
+
+/*分支条件在支配路径上已知时直接改为跳转；在某个前驱上已知时，
+  为这条边复制一份小的分支块，让前驱直接跳到确定的目标*/
+bool IROptimizer::threadJump(OptFunction *func)
+{
+    static const size_t maxDupSize = 8;
+    static const size_t maxGrowth = 200;
+
+    func->buildAnalysis();
+    std::set<OptBlock *> headerSet;
+    for (OptBlock *block : func->blockVec)
+        if (block->loop && block->loop->header == block)
+            headerSet.insert(block);
+
+    bool changed = false, progress = true;
+    size_t growth = 0;
+    while (progress)
+    {
+        progress = false;
+        func->buildCFG();
+        std::map<std::string, IRInst *> defMap;
+        std::map<std::string, OptBlock *> defBlockMap;
+        for (OptBlock *block : func->blockVec)
+        {
+            for (auto &param : block->paramVec)
+                defBlockMap[param.first] = block;
+            for (IRInst &inst : block->instVec)
+            {
+                if (inst.dest.empty())
+                    continue;
+                defMap[inst.dest] = &inst;
+                defBlockMap[inst.dest] = block;
+            }
+        }
+        /*在定义块之外被使用的值（含块参数）*/
+        std::set<std::string> escapeSet;
+        for (OptBlock *block : func->blockVec)
+            for (IRInst &inst : block->instVec)
+                for (const std::string &value : inst.uses())
+                    if (defBlockMap.count(value) && defBlockMap[value] != block)
+                        escapeSet.insert(value);
+        DefLookup lookup = [&defMap](const std::string &value) -> const IRInst *
+        {
+            auto iter = defMap.find(value);
+            return iter == defMap.end() ? NULL : iter->second;
+        };
+
+        for (OptBlock *block : func->blockVec)
+        {
+            IRInst &term = block->terminator();
+            if (term.op != "br")
+                continue;
+            BranchFacts facts;
+            collectFacts(lookup, block, facts);
+            bool result;
+            if (decideCond(lookup, term.args[0], facts, result))
+            {
+                IRInst jumpInst(std::string(), std::string("jump"));
+                jumpInst.labels.push_back(term.labels[result ? 0 : 1]);
+                jumpInst.labelArgs.push_back(term.labelArgs[result ? 0 : 1]);
+                term = jumpInst;
+                progress = changed = true;
+                break;
+            }
+
+            if (block == func->blockVec.front() || headerSet.count(block) ||
+                block->instVec.size() - 1 > maxDupSize ||
+                growth + block->instVec.size() > maxGrowth)
+                continue;
+            bool local = true;
+            for (auto &param : block->paramVec)
+                local &= !escapeSet.count(param.first);
+            for (IRInst &inst : block->instVec)
+                local &= inst.op != "alloc" && !escapeSet.count(inst.dest);
+            if (!local)
+                continue;
+
+            for (OptBlock *pred : block->predVec)
+            {
+                IRInst &predTerm = pred->terminator();
+                for (size_t i = 0; i < predTerm.labels.size() && !progress; i++)
+                {
+                    if (pred == block || predTerm.labels[i] != block->blockName)
+                        continue;
+                    /*把块参数换成这条边传入的值，能折叠的指令先折叠*/
+                    std::map<std::string, std::string> substMap;
+                    for (size_t j = 0; j < block->paramVec.size(); j++)
+                        substMap[block->paramVec[j].first] = predTerm.labelArgs[i][j];
+                    std::map<std::string, IRInst> evalMap;
+                    for (size_t j = 0; j + 1 < block->instVec.size(); j++)
+                    {
+                        IRInst inst = block->instVec[j];
+                        for (std::string *ref : inst.useRefs())
+                            if (substMap.count(*ref))
+                                *ref = substMap[*ref];
+                        int res;
+                        if (inst.isBinary() && IRInst::isConst(inst.args[0]) &&
+                            IRInst::isConst(inst.args[1]) &&
+                            IRInst::evalBinary(inst.op, IRInst::constValue(inst.args[0]),
+                                               IRInst::constValue(inst.args[1]), res))
+                            substMap[inst.dest] = std::to_string(res);
+                        else if (!inst.dest.empty())
+                            evalMap[inst.dest] = inst;
+                    }
+                    DefLookup edgeLookup = [&evalMap, &lookup](const std::string &value)
+                    {
+                        auto iter = evalMap.find(value);
+                        return iter == evalMap.end() ? lookup(value) : &iter->second;
+                    };
+                    BranchFacts edgeFacts;
+                    if (predTerm.op == "br" && predTerm.labels[0] != predTerm.labels[1])
+                        addFact(lookup, predTerm.args[0], i == 0, edgeFacts);
+                    collectFacts(lookup, pred, edgeFacts);
+                    std::string cond = term.args[0];
+                    if (substMap.count(cond))
+                        cond = substMap[cond];
+                    if (!decideCond(edgeLookup, cond, edgeFacts, result))
+                        continue;
+
+                    /*复制分支块，结尾改为跳到确定的目标*/
+                    OptBlock *clone = new OptBlock(func->getNextBlockIdent());
+                    std::map<std::string, std::string> nameMap;
+                    for (size_t j = 0; j < block->paramVec.size(); j++)
+                        nameMap[block->paramVec[j].first] = predTerm.labelArgs[i][j];
+                    for (size_t j = 0; j + 1 < block->instVec.size(); j++)
+                    {
+                        IRInst inst = block->instVec[j];
+                        for (std::string *ref : inst.useRefs())
+                            if (nameMap.count(*ref))
+                                *ref = nameMap[*ref];
+                        if (!inst.dest.empty())
+                            inst.dest = nameMap[inst.dest] = func->getNextVarIdent();
+                        clone->instVec.push_back(inst);
+                    }
+                    IRInst jumpInst(std::string(), std::string("jump"));
+                    jumpInst.labels.push_back(term.labels[result ? 0 : 1]);
+                    jumpInst.labelArgs.push_back(term.labelArgs[result ? 0 : 1]);
+                    for (std::string *ref : jumpInst.useRefs())
+                        if (nameMap.count(*ref))
+                            *ref = nameMap[*ref];
+                    clone->instVec.push_back(jumpInst);
+                    predTerm.labels[i] = clone->blockName;
+                    predTerm.labelArgs[i].clear();
+                    auto &blockVec = func->blockVec;
+                    blockVec.insert(std::find(blockVec.begin(), blockVec.end(), block) + 1, clone);
+                    growth += clone->instVec.size();
+                    progress = changed = true;
+                }
+                if (progress)
+                    break;
+            }
+            if (progress)
+                break;
+        }
+    }
+    if (changed)
+        func->buildCFG();
+    return changed;
+}
+
+/*用值域分析折叠结果确定的比较和分支，非负数除以、模 2 的正幂改为移位和按位与*/
+bool IROptimizer::simplifyRange(OptFunction *func)
+{
+    func->buildAnalysis();
+    OptRange range(func);
+    bool changed = false;
+    std::vector<std::pair<std::string, std::string>> replaceVec;
+    for (OptBlock *block : func->blockVec)
+    {
+        for (IRInst &inst : block->instVec)
+        {
+            bool result;
+            if (inst.op == "br" && !IRInst::isConst(inst.args[0]) &&
+                range.decide(inst.args[0], block, result))
+            {
+                inst.args[0] = result ? "1" : "0";
+                changed = true;
+            }
+            if (!inst.isBinary() || IRInst::isConst(inst.args[0]))
+                continue;
+            OptRange::Interval value = range.rangeMap[inst.dest];
+            if (value.lo == value.hi && !inst.hasSideEffect())
+            {
+                replaceVec.push_back(std::make_pair(inst.dest, std::to_string(value.lo)));
+                continue;
+            }
+            if ((inst.op != "div" && inst.op != "mod") || !IRInst::isConst(inst.args[1]))
+                continue;
+            int divisor = IRInst::constValue(inst.args[1]);
+            OptRange::Interval dividend = range.getRange(inst.args[0], block);
+            if (divisor <= 1 || (divisor & (divisor - 1)) != 0 || dividend.lo < 0 ||
+                dividend.lo > dividend.hi)
+                continue;
+            int shift = 0;
+            while ((1 << shift) != divisor)
+                shift++;
+            inst.op = (inst.op == "div") ? "shr" : "and";
+            inst.args[1] = std::to_string(inst.op == "shr" ? shift : divisor - 1);
+            changed = true;
+        }
+    }
+    for (auto &replace : replaceVec)
+        func->replaceAllUses(replace.first, replace.second);
+    return changed || !replaceVec.empty();
+}
+
+/*窥孔化简：常数放到右边，按代数恒等式化简，并把常数结合到一起*/
+bool IROptimizer::combineInst(OptFunction *func)
+{
+    static const int maxRewrite = 8;
+    static const std::set<std::string> commutativeSet = {"add", "mul", "and", "or",
+                                                         "xor", "eq",  "ne"};
+    static const std::set<std::string> associativeSet = {"add", "mul", "and", "or", "xor"};
+
+    bool changed = false;
+    std::map<std::string, int> useCount = func->countUses();
+    std::map<std::string, IRInst> defMap;
+    std::map<std::string, std::string> replaceMap;
+    auto findDef = [&defMap](const std::string &value) -> const IRInst *
+    {
+        auto iter = defMap.find(value);
+        return iter == defMap.end() ? NULL : &iter->second;
+    };
+    std::function<bool(const std::string &, int)> isBool =
+        [&](const std::string &value, int depth)
+    {
+        if (value == "0" || value == "1")
+            return true;
+        const IRInst *def = findDef(value);
+        if (!def || depth > 4)
+            return false;
+        if (notCmpMap.count(def->op))
+            return true;
+        return (def->op == "and" || def->op == "or" || def->op == "xor") &&
+               isBool(def->args[0], depth + 1) && isBool(def->args[1], depth + 1);
+    };
+    auto isNeg = [&findDef](const std::string &value)
+    {
+        const IRInst *def = findDef(value);
+        return def && def->op == "sub" && def->args[0] == "0";
+    };
+
+    /*化简一步：改写了 inst 返回 true；能替换为已有的值时写入 result*/
+    std::vector<IRInst> *instVec = NULL;
+    auto rewrite = [&](IRInst &inst, std::string &result)
+    {
+        std::string &a = inst.args[0], &b = inst.args[1];
+        bool ca = IRInst::isConst(a), cb = IRInst::isConst(b);
+        int res;
+        if (ca && cb)
+        {
+            if (IRInst::evalBinary(inst.op, IRInst::constValue(a), IRInst::constValue(b), res))
+                result = std::to_string(res);
+            return false;
+        }
+        if (ca && (commutativeSet.count(inst.op) || swapCmpMap.count(inst.op)))
+        {
+            std::swap(a, b);
+            inst.op = commutativeSet.count(inst.op) ? inst.op : swapCmpMap.at(inst.op);
+            return true;
+        }
+
+        if (a == b)
+        {
+            if (inst.op == "sub" || inst.op == "xor" || inst.op == "ne" || inst.op == "lt" ||
+                inst.op == "gt")
+                result = "0";
+            else if (inst.op == "eq" || inst.op == "le" || inst.op == "ge")
+                result = "1";
+            else if (inst.op == "and" || inst.op == "or")
+                result = a;
+            return false;
+        }
+
+        const IRInst *defA = findDef(a), *defB = findDef(b);
+        if (cb)
+        {
+            int c = IRInst::constValue(b);
+            bool zeroId = inst.op == "add" || inst.op == "sub" || inst.op == "or" ||
+                          inst.op == "xor" || inst.op == "shl" || inst.op == "shr" ||
+                          inst.op == "sar";
+            if ((c == 0 && zeroId) || (c == 1 && (inst.op == "mul" || inst.op == "div")) ||
+                (c == -1 && inst.op == "and"))
+                result = a;
+            else if (c == 0 && (inst.op == "mul" || inst.op == "and"))
+                result = "0";
+            else if ((c == 1 || c == -1) && inst.op == "mod")
+                result = "0";
+            else if (c == -1 && inst.op == "or")
+                result = "-1";
+            /*布尔值与 0、1 的比较*/
+            else if (((inst.op == "ne" && c == 0) || (inst.op == "eq" && c == 1) ||
+                      (inst.op == "and" && c == 1)) &&
+                     isBool(a, 0))
+                result = a;
+            /*(-t) & 1 即布尔值 t 本身*/
+            else if (inst.op == "and" && c == 1 && isNeg(a) && isBool(defA->args[1], 0))
+                result = defA->args[1];
+            if (!result.empty())
+                return false;
+
+            if (c == -1 && (inst.op == "mul" || inst.op == "div"))
+                inst = IRInst(inst.dest, "sub", {"0", a});
+            else if (inst.op == "sub" && c != INT_MIN)
+                inst = IRInst(inst.dest, "add", {a, std::to_string(-c)});
+            /*ge、le 改为 gt、lt，少一条取反指令*/
+            else if (inst.op == "ge" && c != INT_MIN)
+                inst = IRInst(inst.dest, "gt", {a, std::to_string(c - 1)});
+            else if (inst.op == "le" && c != INT_MAX)
+                inst = IRInst(inst.dest, "lt", {a, std::to_string(c + 1)});
+            else if (inst.op == "ne" && c == 1 && isBool(a, 0))
+                inst = IRInst(inst.dest, "eq", {a, "0"});
+            else if (inst.op == "eq" && c == 0 && defA && notCmpMap.count(defA->op))
+                inst = IRInst(inst.dest, notCmpMap.at(defA->op), defA->args);
+            else if (inst.op == "eq" && c == 0 && isBool(a, 0))
+                inst = IRInst(inst.dest, "xor", {a, "1"});
+            /*(x op c1) op c2 => x op (c1 op c2)*/
+            else if (associativeSet.count(inst.op) && defA && defA->op == inst.op &&
+                     IRInst::isConst(defA->args[1]) &&
+                     IRInst::evalBinary(inst.op, IRInst::constValue(defA->args[1]), c, res))
+                inst = IRInst(inst.dest, inst.op, {defA->args[0], std::to_string(res)});
+            else
+                return false;
+            return true;
+        }
+
+        /*消去取负*/
+        if (inst.op == "sub" && a == "0" && isNeg(b))
+        {
+            result = defB->args[1];
+            return false;
+        }
+        if (inst.op == "sub" && isNeg(b))
+            inst = IRInst(inst.dest, "add", {a, defB->args[1]});
+        else if (inst.op == "add" && isNeg(b))
+            inst = IRInst(inst.dest, "sub", {a, defB->args[1]});
+        else if (inst.op == "add" && isNeg(a))
+            inst = IRInst(inst.dest, "sub", {b, defA->args[1]});
+        /*(x + c) + y => (x + y) + c，把常数移到外层以便继续合并*/
+        else if (inst.op == "add" && defA && defA->op == "add" && useCount[a] == 1 &&
+                 IRInst::isConst(defA->args[1]))
+        {
+            std::string sum = func->getNextVarIdent();
+            IRInst inner(sum, "add", {defA->args[0], b});
+            instVec->push_back(inner);
+            defMap[sum] = inner;
+            inst = IRInst(inst.dest, "add", {sum, defA->args[1]});
+        }
+        else if (inst.op == "add" && defB && defB->op == "add" && useCount[b] == 1 &&
+                 IRInst::isConst(defB->args[1]))
+            inst = IRInst(inst.dest, "add", {b, a});
+        else
+            return false;
+        return true;
+    };
+
+    for (OptBlock *block : func->getRPO())
+    {
+        std::vector<IRInst> newVec;
+        instVec = &newVec;
+        for (IRInst inst : block->instVec)
+        {
+            for (std::string *ref : inst.useRefs())
+                if (replaceMap.count(*ref))
+                    *ref = replaceMap[*ref];
+            if (!inst.isBinary())
+            {
+                newVec.push_back(inst);
+                continue;
+            }
+            std::string result;
+            for (int i = 0; i < maxRewrite && rewrite(inst, result); i++)
+                changed = true;
+            if (!result.empty())
+            {
+                replaceMap[inst.dest] = result;
+                changed = true;
+                continue;
+            }
+            defMap[inst.dest] = inst;
+            newVec.push_back(inst);
+        }
+        block->instVec = newVec;
+    }
+    if (changed)
+        for (auto &replace : replaceMap)
+            func->replaceAllUses(replace.first, replace.second);
+    return changed;
+}
+
+/*把小的无副作用菱形、三角形分支改写为基于掩码的无分支选择*/
+bool IROptimizer::convertIf(OptFunction *func)
+{
+    static const size_t maxArmSize = 4;
+    static const size_t maxCost = 4;
+    static const std::set<std::string> pureOpSet = {"ne",  "eq",  "gt",  "lt",  "ge",
+                                                    "le",  "add", "sub", "mul", "and",
+                                                    "or",  "xor", "shl", "shr", "sar"};
+    static const std::set<std::string> boolOpSet = {"ne", "eq", "gt", "lt", "ge", "le"};
+    static const std::set<std::string> signOpSet = {"gt", "lt", "ge", "le"};
+
+    bool changed = false;
+    func->buildCFG();
+    std::map<std::string, IRInst> defMap;
+    for (OptBlock *block : func->blockVec)
+        for (IRInst &inst : block->instVec)
+            if (!inst.dest.empty())
+                defMap[inst.dest] = inst;
+
+    /*cond 是否为 x 的符号测试，negative 表示条件成立时 x 不大于 0*/
+    auto signTest = [&defMap](const std::string &cond, const std::string &x, bool &negative)
+    {
+        auto def = defMap.find(cond);
+        if (def == defMap.end() || !signOpSet.count(def->second.op) || def->second.args.size() != 2)
+            return false;
+        const IRInst &inst = def->second;
+        if (inst.args[1] == "0" && inst.args[0] == x)
+            negative = (inst.op == "lt" || inst.op == "le");
+        else if (inst.args[0] == "0" && inst.args[1] == x)
+            negative = (inst.op == "gt" || inst.op == "ge");
+        else
+            return false;
+        return true;
+    };
+    auto isNeg = [&defMap](const std::string &value, const std::string &x)
+    {
+        auto def = defMap.find(value);
+        return def != defMap.end() && def->second.op == "sub" && def->second.args[0] == "0" &&
+               def->second.args[1] == x;
+    };
+    /*value 是否为 base 加减 delta*/
+    auto isOffset = [&defMap](const std::string &value, const std::string &base, std::string &op,
+                              std::string &delta)
+    {
+        auto def = defMap.find(value);
+        if (def == defMap.end() || (def->second.op != "add" && def->second.op != "sub"))
+            return false;
+        const IRInst &inst = def->second;
+        op = inst.op;
+        if (inst.args[0] == base)
+            delta = inst.args[1];
+        else if (inst.op == "add" && inst.args[1] == base)
+            delta = inst.args[0];
+        else
+            return false;
+        return true;
+    };
+
+    for (OptBlock *block : func->blockVec)
+    {
+        IRInst term = block->terminator();
+        if (term.op != "br" || IRInst::isConst(term.args[0]))
+            continue;
+
+        /*每一臂或者是直接的边，或者是唯一前驱为本块、以 jump 结尾的小块*/
+        std::vector<OptBlock *> armVec;
+        std::vector<std::string> joinVec;
+        std::vector<std::vector<std::string>> argsVec;
+        bool valid = true;
+        for (size_t k = 0; k < 2 && valid; k++)
+        {
+            OptBlock *succ = func->findBlock(term.labels[k]);
+            if (succ == block || succ->predVec.size() != 1 || !succ->paramVec.empty() ||
+                succ->terminator().op != "jump")
+            {
+                joinVec.push_back(term.labels[k]);
+                argsVec.push_back(term.labelArgs[k]);
+                continue;
+            }
+            IRInst &jump = succ->terminator();
+            valid = succ->instVec.size() - 1 <= maxArmSize;
+            for (size_t i = 0; valid && i + 1 < succ->instVec.size(); i++)
+                valid = pureOpSet.count(succ->instVec[i].op) > 0;
+            armVec.push_back(succ);
+            joinVec.push_back(jump.labels[0]);
+            argsVec.push_back(jump.labelArgs[0]);
+        }
+        if (!valid || joinVec[0] != joinVec[1] || joinVec[0] == block->blockName)
+            continue;
+        OptBlock *join = func->findBlock(joinVec[0]);
+
+        /*逐个块参数生成选择，条件掩码按需计算一次*/
+        std::vector<IRInst> codeVec;
+        auto emit = [func, &codeVec, &defMap](const std::string &op, const std::string &lhs,
+                                              const std::string &rhs)
+        {
+            std::string dest = func->getNextVarIdent();
+            codeVec.push_back(IRInst(dest, op, {lhs, rhs}));
+            defMap[dest] = codeVec.back();
+            return dest;
+        };
+        const std::string &cond = term.args[0];
+        std::string mask, notMask;
+        auto getMask = [&]()
+        {
+            if (!mask.empty())
+                return mask;
+            const IRInst *def = defMap.count(cond) ? &defMap[cond] : NULL;
+            /*x < 0 的掩码就是 x 算术右移 31 位*/
+            if (def && def->op == "lt" && def->args[1] == "0")
+                mask = emit("sar", def->args[0], "31");
+            else if (def && boolOpSet.count(def->op))
+                mask = emit("sub", "0", cond);
+            else
+                mask = emit("sub", "0", emit("ne", cond, "0"));
+            return mask;
+        };
+        std::vector<std::string> joinArgs;
+        for (size_t j = 0; valid && j < join->paramVec.size(); j++)
+        {
+            const std::string &tv = argsVec[0][j], &fv = argsVec[1][j];
+            std::string op, delta;
+            bool negative = false;
+            if (tv == fv)
+                joinArgs.push_back(tv);
+            else if (join->paramVec[j].second != "i32")
+                valid = false;
+            /*绝对值：(x ^ (x >> 31)) - (x >> 31)*/
+            else if ((isNeg(tv, fv) && signTest(cond, fv, negative) && negative) ||
+                     (isNeg(fv, tv) && signTest(cond, tv, negative) && !negative))
+            {
+                const std::string &x = negative ? fv : tv;
+                std::string sign = emit("sar", x, "31");
+                joinArgs.push_back(emit("sub", emit("xor", x, sign), sign));
+            }
+            /*条件加减：fv + (delta & mask)*/
+            else if (isOffset(tv, fv, op, delta))
+                joinArgs.push_back(emit(op, fv, emit("and", delta, getMask())));
+            else if (fv == "0")
+                joinArgs.push_back(emit("and", tv, getMask()));
+            else if (tv == "0")
+            {
+                if (notMask.empty())
+                    notMask = emit("xor", getMask(), "-1");
+                joinArgs.push_back(emit("and", fv, notMask));
+            }
+            else
+            {
+                std::string diff = emit("and", emit("xor", tv, fv), getMask());
+                joinArgs.push_back(emit("xor", fv, diff));
+            }
+        }
+        if (!valid)
+            continue;
+
+        /*只有选择仍然用到的臂内指令需要提前执行，代价按新增的指令数计算*/
+        std::set<std::string> usedSet(joinArgs.begin(), joinArgs.end());
+        for (const IRInst &inst : codeVec)
+            usedSet.insert(inst.args.begin(), inst.args.end());
+        std::vector<IRInst> specVec;
+        for (auto arm = armVec.rbegin(); arm != armVec.rend(); arm++)
+        {
+            for (auto inst = (*arm)->instVec.rbegin() + 1; inst != (*arm)->instVec.rend(); inst++)
+            {
+                if (!usedSet.count(inst->dest))
+                    continue;
+                specVec.insert(specVec.begin(), *inst);
+                usedSet.insert(inst->args.begin(), inst->args.end());
+            }
+        }
+        if (specVec.size() + codeVec.size() > maxCost)
+            continue;
+
+        /*两臂的指令提前到本块执行，再无条件跳到汇合块*/
+        block->instVec.pop_back();
+        block->instVec.insert(block->instVec.end(), specVec.begin(), specVec.end());
+        block->instVec.insert(block->instVec.end(), codeVec.begin(), codeVec.end());
+        IRInst jumpInst(std::string(), std::string("jump"));
+        jumpInst.labels.push_back(join->blockName);
+        jumpInst.labelArgs.push_back(joinArgs);
+        block->instVec.push_back(jumpInst);
+        changed = true;
+    }
+    if (changed)
+        func->buildCFG();
+    return changed;
+}
+
+/* END */
@@ -0,0 +1,752 @@
+#include "riscvbuilder.hpp"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+
+typedef std::pair<koopa_raw_basic_block_t, koopa_raw_slice_t> BlockEdge;
+
+static const int argsCountInReg = 8;
+
+const static char *argReg[] = {"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"};
+
+const static char *calleeSavedReg[] = {"s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8"};
+
+static koopa_raw_value_t sliceValue(const koopa_raw_slice_t &slice, size_t index)
+{
+    return (koopa_raw_value_t)(slice.buffer[index]);
+}
+
+/*基本块末尾跳转的目标块及传递的块参数*/
+static std::vector<BlockEdge> blockEdges(const koopa_raw_basic_block_t &block)
+{
+    std::vector<BlockEdge> edgeVec;
+    koopa_raw_value_t term = sliceValue(block->insts, block->insts.len - 1);
+    if (term->kind.tag == KOOPA_RVT_BRANCH)
+    {
+        const koopa_raw_branch_t &branch = term->kind.data.branch;
+        edgeVec.push_back(BlockEdge(branch.true_bb, branch.true_args));
+        edgeVec.push_back(BlockEdge(branch.false_bb, branch.false_args));
+    }
+    else if (term->kind.tag == KOOPA_RVT_JUMP)
+        edgeVec.push_back(BlockEdge(term->kind.data.jump.target, term->kind.data.jump.args));
+    return edgeVec;
+}
+
+/*指令的全部操作数，块参数的实参在跳转边上使用，不在这里收集*/
+static std::vector<koopa_raw_value_t> stmtOperands(const koopa_raw_value_t &stmt)
+{
+    std::vector<koopa_raw_value_t> vec;
+    const koopa_raw_value_kind_t &kind = stmt->kind;
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_LOAD:
+        vec.push_back(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        vec.push_back(kind.data.store.value);
+        vec.push_back(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        vec.push_back(kind.data.get_ptr.src);
+        vec.push_back(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        vec.push_back(kind.data.get_elem_ptr.src);
+        vec.push_back(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        vec.push_back(kind.data.binary.lhs);
+        vec.push_back(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        vec.push_back(kind.data.branch.cond);
+        break;
+    case KOOPA_RVT_CALL:
+        for (size_t i = 0; i < kind.data.call.args.len; i++)
+            vec.push_back(sliceValue(kind.data.call.args, i));
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)
+            vec.push_back(kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+    return vec;
+}
+
+std::vector<koopa_raw_value_t> RiscvBuilder::collectUses(const koopa_raw_value_t &stmt)
+{
+    std::vector<koopa_raw_value_t> useVec;
+    for (koopa_raw_value_t value : stmtOperands(stmt))
+        if (slotValueSet.count(value))
+            useVec.push_back(value);
+    return useVec;
+}
+
+std::set<koopa_raw_value_t> RiscvBuilder::liveOut(const koopa_raw_basic_block_t &block)
+{
+    /*后继块入口活跃的值，加上活跃的块参数对应的实参*/
+    std::set<koopa_raw_value_t> live;
+    for (const BlockEdge &edge : blockEdges(block))
+    {
+        const std::set<koopa_raw_value_t> &liveIn = liveInMap[edge.first];
+        std::set<koopa_raw_value_t> edgeLive = liveIn;
+        for (size_t i = 0; i < edge.second.len; i++)
+            edgeLive.erase(sliceValue(edge.first->params, i));
+        for (size_t i = 0; i < edge.second.len; i++)
+        {
+            koopa_raw_value_t arg = sliceValue(edge.second, i);
+            if (liveIn.count(sliceValue(edge.first->params, i)) && slotValueSet.count(arg))
+                edgeLive.insert(arg);
+        }
+        live.insert(edgeLive.begin(), edgeLive.end());
+    }
+    return live;
+}
+
+void RiscvBuilder::computeLiveness(const koopa_raw_function_t &func)
+{
+    /*有名字且有值的指令、块参数和寄存器传入的函数参数占用栈位置*/
+    slotValueSet.clear();
+    liveInMap.clear();
+    for (size_t i = 0; i < func->params.len && i < argsCountInReg; i++)
+        slotValueSet.insert(sliceValue(func->params, i));
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        for (size_t j = 0; j < block->params.len; j++)
+            slotValueSet.insert(sliceValue(block->params, j));
+        for (size_t j = 0; j < block->insts.len; j++)
+        {
+            koopa_raw_value_t stmt = sliceValue(block->insts, j);
+            if (stmt->name && stmt->ty->tag != KOOPA_RTT_UNIT)
+                slotValueSet.insert(stmt);
+        }
+    }
+
+    /*逆序迭代到不动点，入口活跃集合保留活跃的块参数*/
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = func->bbs.len; i-- > 0;)
+        {
+            koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+            std::set<koopa_raw_value_t> live = liveOut(block);
+            for (size_t j = block->insts.len; j-- > 0;)
+            {
+                koopa_raw_value_t stmt = sliceValue(block->insts, j);
+                live.erase(stmt);
+                for (koopa_raw_value_t value : collectUses(stmt))
+                    live.insert(value);
+            }
+            if (live != liveInMap[block])
+            {
+                liveInMap[block] = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+void RiscvBuilder::assignSlots(const koopa_raw_function_t &func)
+{
+    computeLiveness(func);
+
+    /*定义点与此处活跃的值冲突；块参数在进入块时同时定义*/
+    std::map<koopa_raw_value_t, std::set<koopa_raw_value_t>> interfereMap;
+    std::set<koopa_raw_value_t> crossCallSet;
+    auto interfere =
+        [&interfereMap](koopa_raw_value_t def, const std::set<koopa_raw_value_t> &live)
+    {
+        for (koopa_raw_value_t value : live)
+        {
+            if (value == def)
+                continue;
+            interfereMap[def].insert(value);
+            interfereMap[value].insert(def);
+        }
+    };
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        std::set<koopa_raw_value_t> live = liveOut(block);
+        for (size_t j = block->insts.len; j-- > 0;)
+        {
+            koopa_raw_value_t stmt = sliceValue(block->insts, j);
+            if (slotValueSet.count(stmt))
+            {
+                interfere(stmt, live);
+                live.erase(stmt);
+            }
+            if (stmt->kind.tag == KOOPA_RVT_CALL)
+                crossCallSet.insert(live.begin(), live.end());
+            for (koopa_raw_value_t value : collectUses(stmt))
+                live.insert(value);
+        }
+        for (size_t j = 0; j < block->params.len; j++)
+            interfere(sliceValue(block->params, j), live);
+    }
+
+    /*寄存器传入的参数留在原寄存器中，跨调用活跃的放入被调用者保存寄存器，
+      这样调用前后不需要保存任何调用者保存寄存器*/
+    for (size_t i = 0; i < func->params.len && i < argsCountInReg; i++)
+    {
+        koopa_raw_value_t param = sliceValue(func->params, i);
+        if (!crossCallSet.count(param))
+            regTable[param->name] = argReg[i];
+        else
+        {
+            regTable[param->name] = calleeSavedReg[savedRegVec.size()];
+            savedRegVec.push_back(regTable[param->name]);
+        }
+    }
+
+    /*只被紧接着的下一条指令使用一次的运算结果留在 t0 中，不占栈位置*/
+    std::map<koopa_raw_value_t, int> useCountMap;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        for (size_t j = 0; j < block->insts.len; j++)
+            for (koopa_raw_value_t value : stmtOperands(sliceValue(block->insts, j)))
+                useCountMap[value]++;
+        for (const BlockEdge &edge : blockEdges(block))
+            for (size_t j = 0; j < edge.second.len; j++)
+                useCountMap[sliceValue(edge.second, j)]++;
+    }
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        for (size_t j = 0; j + 1 < block->insts.len; j++)
+        {
+            koopa_raw_value_t stmt = sliceValue(block->insts, j);
+            const koopa_raw_value_kind_t &next = sliceValue(block->insts, j + 1)->kind;
+            if (!slotValueSet.count(stmt) || stmt->kind.tag != KOOPA_RVT_BINARY ||
+                useCountMap[stmt] != 1)
+                continue;
+            bool nextUse = false;
+            if (next.tag == KOOPA_RVT_BINARY)
+                nextUse = next.data.binary.lhs == stmt || next.data.binary.rhs == stmt;
+            else if (next.tag == KOOPA_RVT_BRANCH)
+                nextUse = next.data.branch.cond == stmt;
+            else if (next.tag == KOOPA_RVT_RETURN)
+                nextUse = next.data.ret.value == stmt;
+            else if (next.tag == KOOPA_RVT_STORE)
+                nextUse = next.data.store.value == stmt;
+            if (nextUse)
+                regTable[stmt->name] = "t0";
+        }
+    }
+
+    /*块参数与实参互不冲突时合并到同一个栈位置，这条复制就不需要了*/
+    std::map<koopa_raw_value_t, koopa_raw_value_t> leaderMap;
+    std::map<koopa_raw_value_t, std::vector<koopa_raw_value_t>> memberMap;
+    for (koopa_raw_value_t value : slotValueSet)
+    {
+        leaderMap[value] = value;
+        memberMap[value].push_back(value);
+    }
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        for (const BlockEdge &edge : blockEdges(block))
+        {
+            for (size_t j = 0; j < edge.second.len; j++)
+            {
+                koopa_raw_value_t arg = sliceValue(edge.second, j);
+                if (!slotValueSet.count(arg) || regTable.count(arg->name))
+                    continue;
+                koopa_raw_value_t a = leaderMap[arg];
+                koopa_raw_value_t b = leaderMap[sliceValue(edge.first->params, j)];
+                if (a == b)
+                    continue;
+                bool conflict = false;
+                for (koopa_raw_value_t member : memberMap[b])
+                    conflict |= interfereMap[a].count(member) > 0;
+                if (conflict)
+                    continue;
+                for (koopa_raw_value_t member : memberMap[b])
+                {
+                    leaderMap[member] = a;
+                    memberMap[a].push_back(member);
+                }
+                memberMap.erase(b);
+                interfereMap[a].insert(interfereMap[b].begin(), interfereMap[b].end());
+            }
+        }
+    }
+
+    /*合并后的集合按定义顺序着色，互不冲突的集合共用栈位置，排在调用的栈上实参之后*/
+    std::vector<koopa_raw_value_t> orderVec;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        for (size_t j = 0; j < block->params.len; j++)
+            orderVec.push_back(sliceValue(block->params, j));
+        for (size_t j = 0; j < block->insts.len; j++)
+            if (slotValueSet.count(sliceValue(block->insts, j)))
+                orderVec.push_back(sliceValue(block->insts, j));
+    }
+    std::map<koopa_raw_value_t, int> slotMap;
+    int slotCount = 0;
+    for (koopa_raw_value_t value : orderVec)
+    {
+        if (regTable.count(value->name))
+            continue;
+        koopa_raw_value_t leader = leaderMap[value];
+        if (!slotMap.count(leader))
+        {
+            std::set<int> usedSet;
+            for (koopa_raw_value_t other : interfereMap[leader])
+                if (slotMap.count(leaderMap[other]))
+                    usedSet.insert(slotMap[leaderMap[other]]);
+            int index = outArgCount;
+            while (usedSet.count(index))
+                index++;
+            slotMap[leader] = index;
+            slotCount = std::max(slotCount, index + 1 - outArgCount);
+        }
+        varTable[value->name] = slotMap[leader];
+    }
+    funcCommandCount = outArgCount + slotCount;
+}
+
+void RiscvBuilder::assignAllocs(const koopa_raw_function_t &func)
+{
+    /*每个指针可能指向的局部 alloc，沿取元素指针和块参数传播*/
+    std::map<koopa_raw_value_t, std::set<koopa_raw_value_t>> pointMap;
+    std::vector<koopa_raw_value_t> allocVec;
+    std::map<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t>> predMap;
+    auto merge = [&pointMap](koopa_raw_value_t dest, koopa_raw_value_t src)
+    {
+        if (!pointMap.count(src))
+            return false;
+        size_t size = pointMap[dest].size();
+        pointMap[dest].insert(pointMap[src].begin(), pointMap[src].end());
+        return pointMap[dest].size() != size;
+    };
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        for (const BlockEdge &edge : blockEdges(block))
+            predMap[edge.first].push_back(block);
+        for (size_t j = 0; j < block->insts.len; j++)
+        {
+            koopa_raw_value_t stmt = sliceValue(block->insts, j);
+            if (stmt->kind.tag != KOOPA_RVT_ALLOC)
+                continue;
+            allocVec.push_back(stmt);
+            pointMap[stmt].insert(stmt);
+        }
+    }
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+            for (size_t j = 0; j < block->insts.len; j++)
+            {
+                koopa_raw_value_t stmt = sliceValue(block->insts, j);
+                if (stmt->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+                    changed |= merge(stmt, stmt->kind.data.get_elem_ptr.src);
+                else if (stmt->kind.tag == KOOPA_RVT_GET_PTR)
+                    changed |= merge(stmt, stmt->kind.data.get_ptr.src);
+            }
+            for (const BlockEdge &edge : blockEdges(block))
+                for (size_t j = 0; j < edge.second.len; j++)
+                    changed |= merge(sliceValue(edge.first->params, j), sliceValue(edge.second, j));
+        }
+    }
+
+    /*读写、传给调用的位置都算访问；地址被存入内存的 alloc 不参与共用*/
+    std::map<koopa_raw_basic_block_t, std::map<koopa_raw_value_t, std::pair<int, int>>> rangeMap;
+    std::set<koopa_raw_value_t> escapedSet;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        for (size_t j = 0; j < block->insts.len; j++)
+        {
+            koopa_raw_value_t stmt = sliceValue(block->insts, j);
+            const koopa_raw_value_kind_t &kind = stmt->kind;
+            std::vector<koopa_raw_value_t> ptrVec;
+            if (kind.tag == KOOPA_RVT_LOAD)
+                ptrVec.push_back(kind.data.load.src);
+            else if (kind.tag == KOOPA_RVT_STORE)
+            {
+                ptrVec.push_back(kind.data.store.dest);
+                if (pointMap.count(kind.data.store.value))
+                    escapedSet.insert(pointMap[kind.data.store.value].begin(),
+                                      pointMap[kind.data.store.value].end());
+            }
+            else if (kind.tag == KOOPA_RVT_CALL)
+                for (size_t k = 0; k < kind.data.call.args.len; k++)
+                    ptrVec.push_back(sliceValue(kind.data.call.args, k));
+            else if (kind.tag == KOOPA_RVT_RETURN && kind.data.ret.value &&
+                     pointMap.count(kind.data.ret.value))
+                escapedSet.insert(pointMap[kind.data.ret.value].begin(),
+                                  pointMap[kind.data.ret.value].end());
+            for (koopa_raw_value_t ptr : ptrVec)
+            {
+                if (!pointMap.count(ptr))
+                    continue;
+                for (koopa_raw_value_t alloc : pointMap[ptr])
+                {
+                    std::map<koopa_raw_value_t, std::pair<int, int>> &accessMap = rangeMap[block];
+                    if (!accessMap.count(alloc))
+                        accessMap[alloc] = std::make_pair((int)j, (int)j);
+                    accessMap[alloc].second = j;
+                }
+            }
+        }
+    }
+
+    /*访问过之后、还会再被访问之前，alloc 的内容才需要保留*/
+    std::map<koopa_raw_basic_block_t, std::set<koopa_raw_value_t>> availInMap, liveOutMap;
+    changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 0; i < func->bbs.len; i++)
+        {
+            koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+            std::set<koopa_raw_value_t> avail;
+            for (koopa_raw_basic_block_t pred : predMap[block])
+            {
+                avail.insert(availInMap[pred].begin(), availInMap[pred].end());
+                for (auto &access : rangeMap[pred])
+                    avail.insert(access.first);
+            }
+            std::set<koopa_raw_value_t> live;
+            for (const BlockEdge &edge : blockEdges(block))
+            {
+                live.insert(liveOutMap[edge.first].begin(), liveOutMap[edge.first].end());
+                for (auto &access : rangeMap[edge.first])
+                    live.insert(access.first);
+            }
+            if (avail != availInMap[block] || live != liveOutMap[block])
+                changed = true;
+            availInMap[block] = avail;
+            liveOutMap[block] = live;
+        }
+    }
+
+    /*块内各 alloc 需要保留内容的指令区间重叠时互相冲突*/
+    std::map<koopa_raw_value_t, std::set<koopa_raw_value_t>> interfereMap;
+    for (size_t i = 0; i < func->bbs.len; i++)
+    {
+        koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[i]);
+        std::map<koopa_raw_value_t, std::pair<int, int>> &accessMap = rangeMap[block];
+        std::vector<std::pair<koopa_raw_value_t, std::pair<int, int>>> activeVec;
+        for (koopa_raw_value_t alloc : allocVec)
+        {
+            bool accessed = accessMap.count(alloc) > 0;
+            bool avail = availInMap[block].count(alloc) > 0;
+            bool live = liveOutMap[block].count(alloc) > 0;
+            if (!(avail || accessed) || !(live || accessed))
+                continue;
+            int begin = avail ? 0 : accessMap[alloc].first;
+            int end = live ? (int)block->insts.len : accessMap[alloc].second;
+            activeVec.push_back(std::make_pair(alloc, std::make_pair(begin, end)));
+        }
+        for (size_t j = 0; j < activeVec.size(); j++)
+        {
+            for (size_t k = 0; k < j; k++)
+            {
+                const std::pair<int, int> &a = activeVec[j].second, &b = activeVec[k].second;
+                if (a.first > b.second || b.first > a.second)
+                    continue;
+                interfereMap[activeVec[j].first].insert(activeVec[k].first);
+                interfereMap[activeVec[k].first].insert(activeVec[j].first);
+            }
+        }
+    }
+
+    /*按声明顺序放到不与冲突者重叠的最低偏移*/
+    allocOffsetMap.clear();
+    allocAreaSize = 0;
+    for (koopa_raw_value_t alloc : allocVec)
+    {
+        int size = calcArrayTypeSize(alloc->ty->data.pointer.base);
+        std::vector<std::pair<int, int>> usedVec;
+        for (auto &placed : allocOffsetMap)
+        {
+            if (!interfereMap[alloc].count(placed.first) && !escapedSet.count(alloc) &&
+                !escapedSet.count(placed.first))
+                continue;
+            int placedSize = calcArrayTypeSize(placed.first->ty->data.pointer.base);
+            usedVec.push_back(std::make_pair(placed.second, placed.second + placedSize));
+        }
+        std::sort(usedVec.begin(), usedVec.end());
+        int offset = 0;
+        for (const std::pair<int, int> &used : usedVec)
+            if (used.first < offset + size && offset < used.second)
+                offset = std::max(offset, used.second);
+        allocOffsetMap[alloc] = offset;
+        allocAreaSize = std::max(allocAreaSize, offset + size);
+    }
+}
+
+bool RiscvBuilder::needFrame(const koopa_raw_basic_block_t &block)
+{
+    /*用到栈位置、栈上传入的参数、数组或者有调用的块需要栈帧*/
+    for (size_t i = 0; i < block->insts.len; i++)
+    {
+        koopa_raw_value_t stmt = sliceValue(block->insts, i);
+        if (stmt->kind.tag == KOOPA_RVT_CALL || stmt->kind.tag == KOOPA_RVT_ALLOC)
+            return true;
+        if (slotValueSet.count(stmt) && !regTable.count(stmt->name))
+            return true;
+        for (koopa_raw_value_t value : stmtOperands(stmt))
+        {
+            if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF &&
+                value->kind.data.func_arg_ref.index >= argsCountInReg)
+                return true;
+            if (slotValueSet.count(value) && !regTable.count(value->name))
+                return true;
+        }
+    }
+    for (const BlockEdge &edge : blockEdges(block))
+        for (size_t i = 0; i < edge.second.len; i++)
+            if (liveInMap[edge.first].count(sliceValue(edge.first->params, i)))
+                return true;
+    return false;
+}
+
+void RiscvBuilder::placeFrame(const koopa_raw_function_t &func)
+{
+    frameBlock = NULL;
+    frameBlockSet.clear();
+    outerRegTable = regTable;
+    if (func->bbs.len == 0)
+        return;
+
+    /*逆后序和直接支配者*/
+    koopa_raw_basic_block_t entry = (koopa_raw_basic_block_t)(func->bbs.buffer[0]);
+    std::vector<koopa_raw_basic_block_t> rpo;
+    std::map<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t>> predMap;
+    std::set<koopa_raw_basic_block_t> visited;
+    std::function<void(koopa_raw_basic_block_t)> dfs = [&](koopa_raw_basic_block_t block)
+    {
+        visited.insert(block);
+        for (const BlockEdge &edge : blockEdges(block))
+        {
+            predMap[edge.first].push_back(block);
+            if (!visited.count(edge.first))
+                dfs(edge.first);
+        }
+        rpo.push_back(block);
+    };
+    dfs(entry);
+    std::reverse(rpo.begin(), rpo.end());
+    std::map<koopa_raw_basic_block_t, int> orderMap;
+    for (size_t i = 0; i < rpo.size(); i++)
+        orderMap[rpo[i]] = i;
+    std::map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> idomMap;
+    idomMap[entry] = entry;
+    auto intersect = [&](koopa_raw_basic_block_t a, koopa_raw_basic_block_t b)
+    {
+        while (a != b)
+        {
+            while (orderMap[a] > orderMap[b])
+                a = idomMap[a];
+            while (orderMap[b] > orderMap[a])
+                b = idomMap[b];
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); i++)
+        {
+            koopa_raw_basic_block_t idom = NULL;
+            for (koopa_raw_basic_block_t pred : predMap[rpo[i]])
+                if (idomMap.count(pred))
+                    idom = idom ? intersect(idom, pred) : pred;
+            if (idomMap[rpo[i]] != idom)
+            {
+                idomMap[rpo[i]] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    /*序言放在所有需要栈帧的块的最近公共支配者中*/
+    for (koopa_raw_basic_block_t block : rpo)
+        if (needFrame(block))
+            frameBlock = frameBlock ? intersect(frameBlock, block) : block;
+    if (!frameBlock)
+        return;
+
+    /*从序言块出发能到达的块都要被它支配，且不能回到它，否则序言会被绕过或重复执行*/
+    std::vector<koopa_raw_basic_block_t> workVec(1, frameBlock);
+    frameBlockSet.insert(frameBlock);
+    bool valid = true;
+    while (!workVec.empty())
+    {
+        koopa_raw_basic_block_t block = workVec.back();
+        workVec.pop_back();
+        for (const BlockEdge &edge : blockEdges(block))
+        {
+            valid &= edge.first != frameBlock;
+            if (frameBlockSet.insert(edge.first).second)
+                workVec.push_back(edge.first);
+        }
+    }
+    for (koopa_raw_basic_block_t block : frameBlockSet)
+    {
+        koopa_raw_basic_block_t dom = block;
+        while (dom != frameBlock && dom != entry)
+            dom = idomMap[dom];
+        valid &= dom == frameBlock;
+    }
+    if (!valid || frameBlock == entry)
+    {
+        frameBlock = entry;
+        frameBlockSet.insert(rpo.begin(), rpo.end());
+        return;
+    }
+
+    /*栈帧建立之前，跨调用活跃的参数还在传入的寄存器中*/
+    for (size_t i = 0; i < func->params.len && i < argsCountInReg; i++)
+        outerRegTable[sliceValue(func->params, i)->name] = argReg[i];
+}
+
+std::vector<std::string> RiscvBuilder::copyBlockArgs(const koopa_raw_basic_block_t &target,
+                                                     const koopa_raw_slice_t &args)
+{
+    /*并行复制：源为 -1 表示常量等，-2 表示暂存在 t1 中的值*/
+    static const int otherSource = -1;
+    static const int savedSource = -2;
+    struct Copy
+    {
+        int dest;
+        int source;
+        koopa_raw_value_t value;
+    };
+    std::vector<Copy> copyVec;
+    const std::set<koopa_raw_value_t> &liveIn = liveInMap[target];
+    for (size_t i = 0; i < args.len; i++)
+    {
+        koopa_raw_value_t param = sliceValue(target->params, i);
+        koopa_raw_value_t arg = sliceValue(args, i);
+        if (!liveIn.count(param))
+            continue;
+        Copy copy = {matchVarIndex(param->name), otherSource, arg};
+        if (slotValueSet.count(arg) && !regTable.count(arg->name))
+            copy.source = matchVarIndex(arg->name);
+        if (copy.source != copy.dest)
+            copyVec.push_back(copy);
+    }
+
+    /*先做目标不再被读取的复制，只剩环时把一个目标暂存到 t1 打破环*/
+    std::vector<std::string> vec;
+    auto append = [&vec](const std::vector<std::string> &insts)
+    { vec.insert(vec.end(), insts.begin(), insts.end()); };
+    while (!copyVec.empty())
+    {
+        size_t ready = 0;
+        for (; ready < copyVec.size(); ready++)
+        {
+            bool read = false;
+            for (const Copy &copy : copyVec)
+                read |= (copy.source == copyVec[ready].dest);
+            if (!read)
+                break;
+        }
+        if (ready == copyVec.size())
+        {
+            int dest = copyVec[0].dest;
+            append(accessStack("lw", "t1", dest * 4));
+            for (Copy &copy : copyVec)
+                if (copy.source == dest)
+                    copy.source = savedSource;
+            continue;
+        }
+        const Copy &copy = copyVec[ready];
+        std::string reg("t0");
+        if (copy.source == savedSource)
+            reg = "t1";
+        else if (copy.source == otherSource && copy.value->name &&
+                 regTable.count(copy.value->name))
+            reg = regTable[copy.value->name];
+        else if (copy.source == otherSource)
+            append(loadValue(copy.value, "t0"));
+        else
+            append(accessStack("lw", "t0", copy.source * 4));
+        append(accessStack("sw", reg.c_str(), copy.dest * 4));
+        copyVec.erase(copyVec.begin() + ready);
+    }
+    return vec;
+}
+
+std::vector<std::string> RiscvBuilder::copyCallArgs(const koopa_raw_slice_t &args)
+{
+    std::vector<std::string> vec;
+    auto append = [&vec](const std::vector<std::string> &insts)
+    { vec.insert(vec.end(), insts.begin(), insts.end()); };
+
+    /*栈上的实参写入预留的区域，要在覆盖 a0-a7 之前完成*/
+    for (size_t i = argsCountInReg; i < args.len; i++)
+    {
+        koopa_raw_value_t arg = sliceValue(args, i);
+        std::string reg("t0");
+        if (arg->name && regTable.count(arg->name))
+            reg = regTable[arg->name];
+        else
+            append(loadValue(arg, "t0"));
+        append(accessStack("sw", reg.c_str(), (i - argsCountInReg) * 4));
+    }
+
+    /*寄存器实参是一组并行复制，源为空表示从栈上或常量装入*/
+    struct Move
+    {
+        std::string dest;
+        std::string source;
+        koopa_raw_value_t value;
+    };
+    std::vector<Move> moveVec;
+    for (size_t i = 0; i < args.len && i < argsCountInReg; i++)
+    {
+        koopa_raw_value_t arg = sliceValue(args, i);
+        Move move = {argReg[i], std::string(), arg};
+        if (arg->name && regTable.count(arg->name))
+            move.source = regTable[arg->name];
+        if (move.source != move.dest)
+            moveVec.push_back(move);
+    }
+    while (!moveVec.empty())
+    {
+        size_t ready = 0;
+        for (; ready < moveVec.size(); ready++)
+        {
+            bool read = false;
+            for (const Move &move : moveVec)
+                read |= (move.source == moveVec[ready].dest);
+            if (!read)
+                break;
+        }
+        if (ready == moveVec.size())
+        {
+            std::string dest = moveVec[0].dest;
+            vec.push_back("mv t0, " + dest);
+            for (Move &move : moveVec)
+                if (move.source == dest)
+                    move.source = "t0";
+            continue;
+        }
+        const Move &move = moveVec[ready];
+        if (move.source.empty())
+            append(loadValue(move.value, move.dest.c_str()));
+        else
+            vec.push_back("mv " + move.dest + ", " + move.source);
+        moveVec.erase(moveVec.begin() + ready);
+    }
+    return vec;
+}
+
+/* END */
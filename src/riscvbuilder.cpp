@@ -1,5 +1,7 @@
 #include "riscvbuilder.hpp"
+#include "keyword.hpp"
 #include <cassert>
+#include <algorithm>
 #include <functional>
 #include <vector>
 
@@ -28,8 +30,10 @@ const static char *argReg[] = {"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"};
 static const int argsCountInReg = 8;
 
 RiscvBuilder::RiscvBuilder()
-    : rawProgram(NULL), funcCommandCount(0), funcAllocArray(), mem4Byte(0), funcCount(0),
-      currentCommandIndex(0), varTable(), instVec()
+    : rawProgram(NULL), funcCommandCount(0), outArgCount(0), allocAreaSize(0), allocOffsetMap(),
+      mem4Byte(0), funcCount(0), currentCommandIndex(0), varTable(), slotValueSet(), liveInMap(),
+      regTable(), savedRegVec(), frameBlock(NULL), frameBlockSet(), outerRegTable(), prologueVec(),
+      currentInFrame(true), instVec()
 {
 }
 
@@ -58,10 +62,25 @@ void RiscvBuilder::visitRawProg(const koopa_raw_program_t &rawProg)
 
     assert(rawProg.values.kind == KOOPA_RSIK_VALUE);
     assert(rawProg.funcs.kind == KOOPA_RSIK_FUNCTION);
-    pushPInst("data");
-    pushEmpty();
-    for (size_t i = 0; i < rawProg.values.len; i++)
-        visitGloData((koopa_raw_value_t)(rawProg.values.buffer[i]));
+    /*从不被写的全局变量放入只读段*/
+    std::set<koopa_raw_value_t> readOnlySet = collectReadOnly(rawProg);
+    for (bool readOnly : {false, true})
+    {
+        bool sectionPushed = false;
+        for (size_t i = 0; i < rawProg.values.len; i++)
+        {
+            koopa_raw_value_t gloData = (koopa_raw_value_t)(rawProg.values.buffer[i]);
+            if (readOnlySet.count(gloData) != readOnly)
+                continue;
+            if (!sectionPushed)
+            {
+                pushPInst(readOnly ? "section .rodata" : "data");
+                pushEmpty();
+                sectionPushed = true;
+            }
+            visitGloData(gloData);
+        }
+    }
     pushPInst("text");
     pushEmpty();
     for (funcCount = 0; funcCount < rawProg.funcs.len; funcCount++)
@@ -71,6 +90,65 @@ void RiscvBuilder::visitRawProg(const koopa_raw_program_t &rawProg)
     }
 }
 
+std::set<koopa_raw_value_t> RiscvBuilder::collectReadOnly(const koopa_raw_program_t &rawProg)
+{
+    /*全局变量的地址除了作为 load 和取元素指针的源以外被使用，就认为可能被写*/
+    std::function<koopa_raw_value_t(koopa_raw_value_t)> getRoot =
+        [&getRoot](koopa_raw_value_t value) -> koopa_raw_value_t
+    {
+        if (value->kind.tag == KOOPA_RVT_GET_ELEM_PTR)
+            return getRoot(value->kind.data.get_elem_ptr.src);
+        if (value->kind.tag == KOOPA_RVT_GET_PTR)
+            return getRoot(value->kind.data.get_ptr.src);
+        return value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC ? value : NULL;
+    };
+
+    std::set<koopa_raw_value_t> writtenSet;
+    auto markSlice = [&getRoot, &writtenSet](const koopa_raw_slice_t &slice)
+    {
+        for (size_t i = 0; i < slice.len; i++)
+            writtenSet.insert(getRoot((koopa_raw_value_t)(slice.buffer[i])));
+    };
+    for (size_t i = 0; i < rawProg.funcs.len; i++)
+    {
+        koopa_raw_function_t func = (koopa_raw_function_t)(rawProg.funcs.buffer[i]);
+        for (size_t j = 0; j < func->bbs.len; j++)
+        {
+            koopa_raw_basic_block_t block = (koopa_raw_basic_block_t)(func->bbs.buffer[j]);
+            for (size_t k = 0; k < block->insts.len; k++)
+            {
+                koopa_raw_value_t stmt = (koopa_raw_value_t)(block->insts.buffer[k]);
+                const koopa_raw_value_kind_t &kind = stmt->kind;
+                if (kind.tag == KOOPA_RVT_STORE)
+                {
+                    writtenSet.insert(getRoot(kind.data.store.value));
+                    writtenSet.insert(getRoot(kind.data.store.dest));
+                }
+                else if (kind.tag == KOOPA_RVT_CALL)
+                    markSlice(kind.data.call.args);
+                else if (kind.tag == KOOPA_RVT_BRANCH)
+                {
+                    markSlice(kind.data.branch.true_args);
+                    markSlice(kind.data.branch.false_args);
+                }
+                else if (kind.tag == KOOPA_RVT_JUMP)
+                    markSlice(kind.data.jump.args);
+                else if (kind.tag == KOOPA_RVT_RETURN && kind.data.ret.value)
+                    writtenSet.insert(getRoot(kind.data.ret.value));
+            }
+        }
+    }
+
+    std::set<koopa_raw_value_t> readOnlySet;
+    for (size_t i = 0; i < rawProg.values.len; i++)
+    {
+        koopa_raw_value_t gloData = (koopa_raw_value_t)(rawProg.values.buffer[i]);
+        if (!writtenSet.count(gloData))
+            readOnlySet.insert(gloData);
+    }
+    return readOnlySet;
+}
+
 void RiscvBuilder::visitGloData(const koopa_raw_value_t &gloData)
 {
     pushPInst(std::string("globl ") + (gloData->name + 1));
@@ -78,18 +156,36 @@ void RiscvBuilder::visitGloData(const koopa_raw_value_t &gloData)
 
     assert(gloData->kind.tag == KOOPA_RVT_GLOBAL_ALLOC);
     const koopa_raw_global_alloc_t &global_alloc = gloData->kind.data.global_alloc;
-    const koopa_raw_value_kind_t &kind = global_alloc.init->kind;
 
-    if (kind.tag == KOOPA_RVT_INTEGER)
-        pushPInst("word " + std::to_string(kind.data.integer.value));
-    else if (kind.tag == KOOPA_RVT_AGGREGATE)
+    /*连续的零合并为一条 .zero，不展开 zeroinit*/
+    int zeroSize = 0;
+    std::function<void(const koopa_raw_value_t)> factorial =
+        [this, &zeroSize, &factorial](const koopa_raw_value_t value) -> void
     {
-        std::vector<int> vec = aggregateNDto1DVector(global_alloc.init);
-        for (int elem : vec)
-            pushPInst("word " + std::to_string(elem));
-    }
-    else if (kind.tag == KOOPA_RVT_ZERO_INIT)
-        pushPInst("zero " + std::to_string(calcArrayTypeSize(gloData->ty->data.pointer.base) * 4));
+        if (value->kind.tag == KOOPA_RVT_AGGREGATE)
+        {
+            const koopa_raw_slice_t &slice = value->kind.data.aggregate.elems;
+            for (size_t i = 0; i < slice.len; i++)
+                factorial((koopa_raw_value_t)(slice.buffer[i]));
+        }
+        else if (value->kind.tag == KOOPA_RVT_ZERO_INIT)
+            zeroSize += calcArrayTypeSize(value->ty) * 4;
+        else if (value->kind.tag == KOOPA_RVT_INTEGER && value->kind.data.integer.value == 0)
+            zeroSize += 4;
+        else if (value->kind.tag == KOOPA_RVT_INTEGER)
+        {
+            if (zeroSize)
+                pushPInst("zero " + std::to_string(zeroSize));
+            zeroSize = 0;
+            pushPInst("word " + std::to_string(value->kind.data.integer.value));
+        }
+        else
+            assert(false);
+    };
+
+    factorial(global_alloc.init);
+    if (zeroSize)
+        pushPInst("zero " + std::to_string(zeroSize));
 
     pushEmpty();
     return;
@@ -97,29 +193,39 @@ void RiscvBuilder::visitGloData(const koopa_raw_value_t &gloData)
 
 void RiscvBuilder::countFunc(const koopa_raw_function_t &func)
 {
-    static const int moreSpace = 16;
-
     funcCommandCount = 0;
-    funcAllocArray.clear();
+    outArgCount = 0;
+    allocAreaSize = 0;
+    allocOffsetMap.clear();
+    varTable.clear();
+    regTable.clear();
+    savedRegVec.clear();
 
     assert(func->bbs.kind == KOOPA_RSIK_BASIC_BLOCK);
     for (size_t i = 0; i < func->bbs.len; i++)
         countBlock((koopa_raw_basic_block_t)(func->bbs.buffer[i]));
+    if (func->bbs.len)
+    {
+        assignSlots(func);
+        assignAllocs(func);
+    }
+    placeFrame(func);
 
-    mem4Byte = (funcCommandCount + moreSpace + 3) & (-3);
-    for (int elem : funcAllocArray)
-        mem4Byte += elem;
+    /*栈帧自底向上：调用的栈上实参、值的栈位置、数组、保存的寄存器和 ra，按 16 字节对齐*/
+    mem4Byte = funcCommandCount + allocAreaSize + savedRegVec.size() + 1;
+    mem4Byte = (mem4Byte + 3) & (-4);
 }
 
 void RiscvBuilder::visitFunc(const koopa_raw_function_t &func)
 {
     currentCommandIndex = 0;
-    currentAllocedCount = 0;
-    varTable.clear();
 
     /* TODO 函数声明，直接返回，但是这种判断对吗 */
     if (func->bbs.len == 0)
+    {
+        visitBuiltinFunc(func);
         return;
+    }
 
     /* 设置函数头 */
     std::string funcName(func->name + 1);
@@ -131,11 +237,33 @@ void RiscvBuilder::visitFunc(const koopa_raw_function_t &func)
     pushLabel(funcName);
 
     /* 进入函数，分配栈空间 */
-    pushCment("prologue");
-    pushAInst("sw ra, -4(sp)");
-    pushAInst("li t0, " + std::to_string(-mem4Byte * 4));
-    pushAInst("add sp, sp, t0");
-    pushEmpty();
+    prologueVec.clear();
+    prologueVec.push_back("# prologue");
+    prologueVec.push_back("sw ra, -4(sp)");
+    prologueVec.push_back("li t0, " + std::to_string(-mem4Byte * 4));
+    prologueVec.push_back("add sp, sp, t0");
+
+    /* 保存用到的被调用者保存寄存器，再把跨调用活跃的参数移入 */
+    for (size_t i = 0; i < savedRegVec.size(); i++)
+    {
+        std::vector<std::string> vec =
+            accessStack("sw", savedRegVec[i].c_str(), (mem4Byte - 2 - (int)i) * 4);
+        prologueVec.insert(prologueVec.end(), vec.begin(), vec.end());
+    }
+    for (size_t i = 0; i < func->params.len && i < argsCountInReg; i++)
+    {
+        const std::string &reg = regTable[((koopa_raw_value_t)(func->params.buffer[i]))->name];
+        if (reg != argReg[i])
+            prologueVec.push_back("mv " + reg + ", " + argReg[i]);
+    }
+
+    /* 序言在入口时放在第一个块之前，否则放在需要栈帧的块的支配者开头 */
+    if (frameBlock == (koopa_raw_basic_block_t)(func->bbs.buffer[0]))
+    {
+        pushAInst(prologueVec);
+        pushEmpty();
+        prologueVec.clear();
+    }
 
     assert(func->bbs.kind == KOOPA_RSIK_BASIC_BLOCK);
     for (size_t i = 0; i < func->bbs.len; i++)
@@ -144,6 +272,72 @@ void RiscvBuilder::visitFunc(const koopa_raw_function_t &func)
     pushEmpty();
 }
 
+void RiscvBuilder::visitBuiltinFunc(const koopa_raw_function_t &func)
+{
+    /*优化时引入的内建函数，每次处理 4 个字，剩余部分逐个处理*/
+    std::string funcName(func->name + 1);
+    bool isBuiltin = false;
+    for (auto p = builtinFuncDecl; (*p)[0]; p++)
+        isBuiltin |= (funcName == (*p)[0]);
+    if (!isBuiltin)
+        return;
+
+    /*参数依次在 a0, a1, a2 中，元素个数为最后一个参数*/
+    const char *count = (funcName == "__sysy_sum") ? "a1" : "a2";
+    std::string label = "BUILTIN_" + funcName;
+    pushLabel(funcName);
+    if (funcName == "__sysy_sum")
+        pushAInst("li t5, 0");
+    pushAInst("li t0, 4");
+    pushAInst(std::string("blt ") + count + ", t0, " + label + "_TAIL");
+    pushLabel(label + "_LOOP");
+    for (int i = 0; i < 4; i++)
+    {
+        std::string offset = std::to_string(i * 4);
+        std::string reg = "t" + std::to_string(i + 1);
+        if (funcName == "__sysy_fill")
+            pushAInst("sw a1, " + offset + "(a0)");
+        else if (funcName == "__sysy_copy")
+        {
+            pushAInst("lw " + reg + ", " + offset + "(a1)");
+            pushAInst("sw " + reg + ", " + offset + "(a0)");
+        }
+        else
+        {
+            pushAInst("lw " + reg + ", " + offset + "(a0)");
+            pushAInst("add t5, t5, " + reg);
+        }
+    }
+    pushAInst("addi a0, a0, 16");
+    if (funcName == "__sysy_copy")
+        pushAInst("addi a1, a1, 16");
+    pushAInst(std::string("addi ") + count + ", " + count + ", -4");
+    pushAInst(std::string("bge ") + count + ", t0, " + label + "_LOOP");
+    pushLabel(label + "_TAIL");
+    pushAInst(std::string("blez ") + count + ", " + label + "_END");
+    if (funcName == "__sysy_fill")
+        pushAInst("sw a1, 0(a0)");
+    else if (funcName == "__sysy_copy")
+    {
+        pushAInst("lw t1, 0(a1)");
+        pushAInst("sw t1, 0(a0)");
+        pushAInst("addi a1, a1, 4");
+    }
+    else
+    {
+        pushAInst("lw t1, 0(a0)");
+        pushAInst("add t5, t5, t1");
+    }
+    pushAInst("addi a0, a0, 4");
+    pushAInst(std::string("addi ") + count + ", " + count + ", -1");
+    pushAInst("j " + label + "_TAIL");
+    pushLabel(label + "_END");
+    if (funcName == "__sysy_sum")
+        pushAInst("mv a0, t5");
+    pushAInst("ret");
+    pushEmpty();
+}
+
 void RiscvBuilder::countBlock(const koopa_raw_basic_block_t &block)
 {
     assert(block->insts.kind == KOOPA_RSIK_VALUE);
@@ -155,28 +349,29 @@ void RiscvBuilder::visitBlock(const koopa_raw_basic_block_t &block)
 {
     assert(block->insts.kind == KOOPA_RSIK_VALUE);
     pushLabel("BLOCK_" + std::to_string(funcCount) + "_" + (block->name + 1));
+
+    /* 栈帧建立之前的块使用另一套寄存器表，返回时也不需要恢复 */
+    currentInFrame = frameBlockSet.count(block) > 0;
+    if (!currentInFrame)
+        std::swap(regTable, outerRegTable);
+    if (block == frameBlock)
+        pushAInst(prologueVec);
     for (size_t i = 0; i < block->insts.len; i++)
         visitStmt((koopa_raw_value_t)(block->insts.buffer[i]));
+    if (!currentInFrame)
+        std::swap(regTable, outerRegTable);
     pushEmpty();
 }
 
 void RiscvBuilder::countStmt(const koopa_raw_value_t &stmt)
 {
-    funcCommandCount++;
-    if (stmt->kind.tag != KOOPA_RVT_ALLOC)
-    {
-        funcAllocArray.push_back(0);
-        return;
-    }
-    int arraySize = calcArrayTypeSize(stmt->ty->data.pointer.base);
-    funcAllocArray.push_back(arraySize);
+    if (stmt->kind.tag == KOOPA_RVT_CALL)
+        outArgCount = std::max(outArgCount, (int)stmt->kind.data.call.args.len - argsCountInReg);
 }
 
 void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
 {
     // 根据指令类型判断后续需要如何访问
-    pushVarIndex(stmt->name);
-
     switch (stmt->kind.tag)
     {
     case KOOPA_RVT_INTEGER:
@@ -225,12 +420,9 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
     {
         /// Local memory allocation.
         pushCment("KOOPA_RVT_ALLOC");
-        pushAInst("li t1, " + std::to_string((currentAllocedCount + funcCommandCount) * 4));
+        pushAInst("li t1, " + std::to_string((allocOffsetMap[stmt] + funcCommandCount) * 4));
         pushAInst("add t0, sp, t1");
-        pushAInst("li t3, " + std::to_string(currentCommandIndex * 4));
-        pushAInst("add t2, sp, t3");
-        pushAInst("sw t0, 0(t2)");
-        currentAllocedCount += funcAllocArray[currentCommandIndex];
+        pushAInst(storeValue(stmt, "t0"));
     }
     break;
     case KOOPA_RVT_GLOBAL_ALLOC:
@@ -246,8 +438,8 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         pushCment("KOOPA_RVT_LOAD");
 
         const koopa_raw_load_t &load = stmt->kind.data.load;
-        pushAInst(loadValue(load.src, "t0"));
-        pushAInst("lw t1, 0(t0)");
+        std::string src = valueReg(load.src, "t0");
+        pushAInst("lw t1, 0(" + src + ")");
         pushAInst(storeValue(stmt, "t1"));
     }
     break;
@@ -257,22 +449,57 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         pushCment("KOOPA_RVT_STORE");
 
         const koopa_raw_store_t &store = stmt->kind.data.store;
-        if (store.value->kind.tag != KOOPA_RVT_AGGREGATE)
+        if (store.value->kind.tag != KOOPA_RVT_AGGREGATE &&
+            store.value->kind.tag != KOOPA_RVT_ZERO_INIT)
         {
-            pushAInst(loadValue(store.value, "t0"));
-            pushAInst(loadValue(store.dest, "t1"));
-            pushAInst("sw t0, 0(t1)");
+            std::string value = valueReg(store.value, "t0");
+            std::string dest = valueReg(store.dest, "t1");
+            pushAInst("sw " + value + ", 0(" + dest + ")");
         }
         else
         {
+            /*小数组逐个写入，大数组先用循环清零，再只写入非零元素*/
+            static const int maxUnrollSize = 32;
             pushAInst(loadValue(store.dest, "t1"));
             std::vector<int> vec = aggregateNDto1DVector(store.value);
             int length = vec.size();
+            bool zeroLoop = length > maxUnrollSize;
+            if (zeroLoop)
+            {
+                std::string loopLabel = "INIT_" + std::to_string(funcCount) + "_" +
+                                        std::to_string(currentCommandIndex);
+                int loopLength = length / 4 * 4;
+                pushAInst("li t2, " + std::to_string(loopLength * 4));
+                pushAInst("add t2, t1, t2");
+                pushLabel(loopLabel);
+                for (int i = 0; i < 4; i++)
+                    pushAInst("sw zero, " + std::to_string(i * 4) + "(t1)");
+                pushAInst("addi t1, t1, 16");
+                pushAInst("bltu t1, t2, " + loopLabel);
+                for (int i = loopLength; i < length; i++)
+                    pushAInst("sw zero, " + std::to_string((i - loopLength) * 4) + "(t1)");
+                pushAInst(loadValue(store.dest, "t1"));
+            }
+            /*t1 指向下标 base 处，偏移超出立即数范围时前移*/
+            int base = 0;
             for (int i = 0; i < length; i++)
             {
+                if (zeroLoop && vec[i] == 0)
+                    continue;
+                if ((i - base) * 4 > 2047)
+                {
+                    pushAInst("li t2, " + std::to_string((i - base) * 4));
+                    pushAInst("add t1, t1, t2");
+                    base = i;
+                }
+                std::string offset = std::to_string((i - base) * 4);
+                if (vec[i] == 0)
+                {
+                    pushAInst("sw zero, " + offset + "(t1)");
+                    continue;
+                }
                 pushAInst("li t0, " + std::to_string(vec[i]));
-                pushAInst("sw t0, 0(t1)");
-                pushAInst("addi t1, t1, 4");
+                pushAInst("sw t0, " + offset + "(t1)");
             }
         }
     }
@@ -283,12 +510,12 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         pushCment("KOOPA_RVT_GET_PTR");
 
         const koopa_raw_get_ptr_t &get_ptr = stmt->kind.data.get_ptr;
-        pushAInst(loadValue(get_ptr.src, "t0"));
-        pushAInst(loadValue(get_ptr.index, "t1"));
+        std::string src = valueReg(get_ptr.src, "t0");
+        std::string index = valueReg(get_ptr.index, "t1");
         int size = calcArrayTypeSize(get_ptr.src->ty->data.pointer.base) * 4;
         pushAInst("li t2, " + std::to_string(size));
-        pushAInst("mul t3, t1, t2");
-        pushAInst("add t0, t0, t3");
+        pushAInst("mul t3, " + index + ", t2");
+        pushAInst("add t0, " + src + ", t3");
         pushAInst(storeValue(stmt, "t0"));
     }
     break;
@@ -298,12 +525,12 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         pushCment("KOOPA_RVT_GET_ELEM_PTR");
 
         const koopa_raw_get_elem_ptr_t &get_elem_ptr = stmt->kind.data.get_elem_ptr;
-        pushAInst(loadValue(get_elem_ptr.src, "t0"));
-        pushAInst(loadValue(get_elem_ptr.index, "t1"));
+        std::string src = valueReg(get_elem_ptr.src, "t0");
+        std::string index = valueReg(get_elem_ptr.index, "t1");
         int size = calcArrayTypeSize(get_elem_ptr.src->ty->data.pointer.base->data.array.base) * 4;
         pushAInst("li t2, " + std::to_string(size));
-        pushAInst("mul t3, t1, t2");
-        pushAInst("add t0, t0, t3");
+        pushAInst("mul t3, " + index + ", t2");
+        pushAInst("add t0, " + src + ", t3");
         pushAInst(storeValue(stmt, "t0"));
     }
     break;
@@ -313,9 +540,9 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         pushCment("KOOPA_RVT_BINARY");
 
         const koopa_raw_binary_t &binary = stmt->kind.data.binary;
-        pushAInst(loadValue(binary.lhs, "t1"));
-        pushAInst(loadValue(binary.rhs, "t2"));
-        pushAInst(std::string(binaryOPInst[binary.op][0]) + " t0, t1, t2");
+        std::string lhs = valueReg(binary.lhs, "t1");
+        std::string rhs = valueReg(binary.rhs, "t2");
+        pushAInst(std::string(binaryOPInst[binary.op][0]) + " t0, " + lhs + ", " + rhs);
         if (binaryOPInst[binary.op][1])
             pushAInst(binaryOPInst[binary.op][1]);
         pushAInst(storeValue(stmt, "t0"));
@@ -327,10 +554,40 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         pushCment("KOOPA_RVT_BRANCH");
 
         const koopa_raw_branch_t &branch = stmt->kind.data.branch;
-        pushAInst(loadValue(branch.cond, "t0"));
-        pushAInst("beqz t0, 0x8");
-        pushAInst("j BLOCK_" + std::to_string(funcCount) + "_" + (branch.true_bb->name + 1));
-        pushAInst("j BLOCK_" + std::to_string(funcCount) + "_" + (branch.false_bb->name + 1));
+        std::string cond = valueReg(branch.cond, "t0");
+        std::string blockPrefix = "BLOCK_" + std::to_string(funcCount) + "_";
+        std::string trueLabel = blockPrefix + (branch.true_bb->name + 1);
+        std::string falseLabel = blockPrefix + (branch.false_bb->name + 1);
+        std::vector<std::string> trueCopy = copyBlockArgs(branch.true_bb, branch.true_args);
+        std::vector<std::string> falseCopy = copyBlockArgs(branch.false_bb, branch.false_args);
+        if (trueCopy.empty())
+        {
+            /*复制只在假分支上，真分支直接跳转*/
+            pushAInst("beqz " + cond + ", 0x8");
+            pushAInst("j " + trueLabel);
+            pushAInst(falseCopy);
+            pushAInst("j " + falseLabel);
+        }
+        else if (falseCopy.empty())
+        {
+            pushAInst("bnez " + cond + ", 0x8");
+            pushAInst("j " + falseLabel);
+            pushAInst(trueCopy);
+            pushAInst("j " + trueLabel);
+        }
+        else
+        {
+            /*两条边各自插入复制，相当于拆分了关键边*/
+            std::string edgeLabel = "BRANCH_" + std::to_string(funcCount) + "_" +
+                                    std::to_string(currentCommandIndex);
+            pushAInst("bnez " + cond + ", 0x8");
+            pushAInst("j " + edgeLabel);
+            pushAInst(trueCopy);
+            pushAInst("j " + trueLabel);
+            pushLabel(edgeLabel);
+            pushAInst(falseCopy);
+            pushAInst("j " + falseLabel);
+        }
     }
     break;
     case KOOPA_RVT_JUMP:
@@ -339,6 +596,7 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         pushCment("KOOPA_RVT_JUMP");
 
         const koopa_raw_jump_t &jump = stmt->kind.data.jump;
+        pushAInst(copyBlockArgs(jump.target, jump.args));
         pushAInst("j BLOCK_" + std::to_string(funcCount) + "_" + (jump.target->name + 1));
     }
     break;
@@ -349,34 +607,12 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
 
         const koopa_raw_call_t &call = stmt->kind.data.call;
 
-        /*计算*/
-        int argLength = (int)(call.args.len);
-        int regParamCount = std::min(argsCountInReg, argLength);
-
-        /*寄存器上分配参数*/
-        for (uint32_t i = 0; i < regParamCount; i++)
-            pushAInst(loadValue((koopa_raw_value_t)(call.args.buffer[i]), argReg[i]));
-
-        /*栈上分配参数*/
-        for (int i = argsCountInReg; i < argLength; i++)
-        {
-            pushAInst(loadValue((koopa_raw_value_t)(call.args.buffer[i]), "t0"));
-            pushAInst("li t1, " + std::to_string((i - argLength) * 4));
-            pushAInst("add t1, sp, t1");
-            pushAInst("sw t0, 0(t1)");
-        }
-
-        /*分配栈上参数空间*/
-        if (argLength > argsCountInReg)
-            pushAInst("addi sp, sp, " + std::to_string((argsCountInReg - argLength) * 4));
+        /*实参放入 a0-a7 和栈帧底部预留的区域，不再调整 sp*/
+        pushAInst(copyCallArgs(call.args));
 
         /*调用函数*/
         pushAInst("call " + std::string(call.callee->name + 1));
 
-        /*释放栈上参数空间*/
-        if (argLength > argsCountInReg)
-            pushAInst("addi sp, sp, " + std::to_string((argLength - argsCountInReg) * 4));
-
         /*获得返回值*/
         if (stmt->name)
             pushAInst(storeValue(stmt, "a0"));
@@ -390,6 +626,13 @@ void RiscvBuilder::visitStmt(const koopa_raw_value_t &stmt)
         const koopa_raw_return_t &ret = stmt->kind.data.ret;
         if (ret.value)
             pushAInst(loadValue(ret.value, "a0"));
+        if (!currentInFrame)
+        {
+            pushAInst("ret");
+            break;
+        }
+        for (size_t i = 0; i < savedRegVec.size(); i++)
+            pushAInst(accessStack("lw", savedRegVec[i].c_str(), (mem4Byte - 2 - (int)i) * 4));
         pushAInst("li t0, " + std::to_string(mem4Byte * 4));
         pushAInst("add sp, sp, t0");
         pushAInst("lw ra, -4(sp)");
@@ -409,39 +652,24 @@ std::vector<std::string> RiscvBuilder::loadValue(const koopa_raw_value_t &value,
 {
     std::string dist(distReg);
     std::vector<std::string> vec;
-    if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
+    if (value->name && regTable.count(value->name))
+    {
+        if (regTable[value->name] != dist)
+            vec.push_back("mv " + dist + ", " + regTable[value->name]);
+    }
+    else if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
     {
         int index = (int)(value->kind.data.func_arg_ref.index);
         if (index < argsCountInReg)
-            vec.push_back("mv " + dist + ", " + argReg[index]);
+            vec = accessStack("lw", distReg, matchVarIndex(value->name) * 4);
         else
-        {
-            int offset = (mem4Byte + index - argsCountInReg) * 4;
-            if (validOffset(offset))
-                vec.push_back("lw " + dist + ", " + std::to_string(offset) + "(sp)");
-            else
-            {
-                vec.push_back("li t5, " + std::to_string(offset));
-                vec.push_back(std::string("add t5, t5, sp"));
-                vec.push_back("lw " + dist + ", 0(t5)");
-            }
-        }
+            vec = accessStack("lw", distReg, (mem4Byte + index - argsCountInReg) * 4);
     }
     else if (value->name)
     {
         int index = matchVarIndex(value->name);
         if (index != -1)
-        {
-            int offset = index * 4;
-            if (validOffset(offset))
-                vec.push_back("lw " + dist + ", " + std::to_string(offset) + "(sp)");
-            else
-            {
-                vec.push_back("li t5, " + std::to_string(offset));
-                vec.push_back(std::string("add t5, t5, sp"));
-                vec.push_back("lw " + dist + ", 0(t5)");
-            }
-        }
+            vec = accessStack("lw", distReg, index * 4);
         else
             vec.push_back("la " + dist + ", " + (value->name + 1));
     }
@@ -455,6 +683,15 @@ std::vector<std::string> RiscvBuilder::loadValue(const koopa_raw_value_t &value,
     return vec;
 }
 
+std::string RiscvBuilder::valueReg(const koopa_raw_value_t &value, const char *tmpReg)
+{
+    /*已在寄存器中的值直接使用，否则装入 tmpReg*/
+    if (value->name && regTable.count(value->name))
+        return regTable[value->name];
+    pushAInst(loadValue(value, tmpReg));
+    return tmpReg;
+}
+
 bool RiscvBuilder::validOffset(int offset)
 {
     static const int maxOffset = (1 << 11);
@@ -464,20 +701,14 @@ bool RiscvBuilder::validOffset(int offset)
 std::vector<std::string> RiscvBuilder::storeValue(const koopa_raw_value_t &value,
                                                   const char *distReg)
 {
-    std::string dist(distReg);
     std::vector<std::string> vec;
-    if (value->name)
+    if (value->name && regTable.count(value->name))
     {
-        int offset = matchVarIndex(value->name) * 4;
-        if (validOffset(offset))
-            vec.push_back("sw " + dist + ", " + std::to_string(offset) + "(sp)");
-        else
-        {
-            vec.push_back("li t5, " + std::to_string(offset));
-            vec.push_back(std::string("add t5, t5, sp"));
-            vec.push_back("sw " + dist + ", 0(t5)");
-        }
+        if (regTable[value->name] != distReg)
+            vec.push_back("mv " + regTable[value->name] + ", " + distReg);
     }
+    else if (value->name)
+        vec = accessStack("sw", distReg, matchVarIndex(value->name) * 4);
     else
     {
         assert(false);
@@ -486,6 +717,20 @@ std::vector<std::string> RiscvBuilder::storeValue(const koopa_raw_value_t &value
     return vec;
 }
 
+std::vector<std::string> RiscvBuilder::accessStack(const char *op, const char *reg, int offset)
+{
+    std::vector<std::string> vec;
+    if (validOffset(offset))
+        vec.push_back(std::string(op) + " " + reg + ", " + std::to_string(offset) + "(sp)");
+    else
+    {
+        vec.push_back("li t5, " + std::to_string(offset));
+        vec.push_back(std::string("add t5, t5, sp"));
+        vec.push_back(std::string(op) + " " + reg + ", 0(t5)");
+    }
+    return vec;
+}
+
 void RiscvBuilder::pushAInst(std::string ainst) { instVec.push_back("    " + ainst); }
 
 void RiscvBuilder::pushPInst(std::string pinst) { instVec.push_back("    ." + pinst); }
@@ -510,20 +755,6 @@ void RiscvBuilder::pushAInst(const std::vector<std::string> &ainstVec)
 
 void RiscvBuilder::pushEmpty() { instVec.push_back(std::string()); }
 
-void RiscvBuilder::pushVarIndex(std::string name)
-{
-    static int count = 0;
-    int value = varTable.size();
-    if (varTable.find(name) != varTable.end())
-        varTable["+-*/" + name + std::to_string(count++)] = value;
-    else
-        varTable[name] = value;
-}
-
-void RiscvBuilder::pushVarIndex(const char *name) { pushVarIndex(std::string(name ? name : "")); }
-
-void RiscvBuilder::pushVarIndex() { pushVarIndex(std::string()); }
-
 int RiscvBuilder::matchVarIndex(std::string name)
 {
     if (varTable.find(name) == varTable.end())
@@ -569,7 +800,7 @@ std::vector<int> RiscvBuilder::aggregateNDto1DVector(const koopa_raw_value_t val
     std::vector<int> result;
 
     std::function<void(const koopa_raw_value_t)> factorial =
-        [&result, &factorial](const koopa_raw_value_t value) -> void
+        [this, &result, &factorial](const koopa_raw_value_t value) -> void
     {
         if (value->kind.tag == KOOPA_RVT_AGGREGATE)
         {
@@ -577,6 +808,8 @@ std::vector<int> RiscvBuilder::aggregateNDto1DVector(const koopa_raw_value_t val
             for (int i = 0; i < slice.len; i++)
                 factorial((koopa_raw_value_t)(slice.buffer[i]));
         }
+        else if (value->kind.tag == KOOPA_RVT_ZERO_INIT)
+            result.resize(result.size() + calcArrayTypeSize(value->ty), 0);
         else if (value->kind.tag == KOOPA_RVT_INTEGER)
             result.push_back(value->kind.data.integer.value);
         else
@@ -4,6 +4,7 @@
 #include "koopa.h"
 #include <iostream>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -13,14 +14,28 @@ class RiscvBuilder
     koopa_raw_program_t *rawProgram;
 
     int funcCommandCount;
-    std::vector<int> funcAllocArray;
+    int outArgCount;
+    int allocAreaSize;
+    std::map<koopa_raw_value_t, int> allocOffsetMap;
     int mem4Byte;
     int funcCount;
 
     int currentCommandIndex;
-    int currentAllocedCount;
     std::map<std::string, int> varTable;
 
+    /* 值的活跃性，用于分配栈位置和为参数选择寄存器 */
+    std::set<koopa_raw_value_t> slotValueSet;
+    std::map<koopa_raw_basic_block_t, std::set<koopa_raw_value_t>> liveInMap;
+    std::map<std::string, std::string> regTable;
+    std::vector<std::string> savedRegVec;
+
+    /* 收缩包装：序言所在的块和栈帧建立之后才会执行的块 */
+    koopa_raw_basic_block_t frameBlock;
+    std::set<koopa_raw_basic_block_t> frameBlockSet;
+    std::map<std::string, std::string> outerRegTable;
+    std::vector<std::string> prologueVec;
+    bool currentInFrame;
+
     std::vector<std::string> instVec;
 
     RiscvBuilder();
@@ -28,9 +43,11 @@ class RiscvBuilder
 
     void visitRawProg(const koopa_raw_program_t &rawProg);
     void visitGloData(const koopa_raw_value_t &gloData);
+    std::set<koopa_raw_value_t> collectReadOnly(const koopa_raw_program_t &rawProg);
 
     void countFunc(const koopa_raw_function_t &func);
     void visitFunc(const koopa_raw_function_t &func);
+    void visitBuiltinFunc(const koopa_raw_function_t &func);
 
     void countBlock(const koopa_raw_basic_block_t &block);
     void visitBlock(const koopa_raw_basic_block_t &block);
@@ -39,7 +56,19 @@ class RiscvBuilder
     void visitStmt(const koopa_raw_value_t &stmt);
 
     bool validOffset(int offset);
+    std::vector<std::string> accessStack(const char *op, const char *reg, int offset);
+    std::vector<koopa_raw_value_t> collectUses(const koopa_raw_value_t &stmt);
+    std::set<koopa_raw_value_t> liveOut(const koopa_raw_basic_block_t &block);
+    void computeLiveness(const koopa_raw_function_t &func);
+    void assignSlots(const koopa_raw_function_t &func);
+    void assignAllocs(const koopa_raw_function_t &func);
+    bool needFrame(const koopa_raw_basic_block_t &block);
+    void placeFrame(const koopa_raw_function_t &func);
+    std::vector<std::string> copyBlockArgs(const koopa_raw_basic_block_t &target,
+                                           const koopa_raw_slice_t &args);
+    std::vector<std::string> copyCallArgs(const koopa_raw_slice_t &args);
     std::vector<std::string> loadValue(const koopa_raw_value_t &value, const char *distReg);
+    std::string valueReg(const koopa_raw_value_t &value, const char *tmpReg);
     std::vector<std::string> storeValue(const koopa_raw_value_t &value, const char *distReg);
 
     void pushAInst(std::string ainst);
@@ -55,10 +84,6 @@ class RiscvBuilder
     void pushAInst(const std::vector<std::string> &ainstVec);
     void pushEmpty();
 
-    void pushVarIndex(std::string name);
-    void pushVarIndex(const char *name);
-    void pushVarIndex();
-
     int matchVarIndex(std::string name);
     int matchVarIndex(const char *name);
 
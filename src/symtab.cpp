@@ -13,7 +13,7 @@ SymbolEntry::SymbolEntry()
 SymbolEntry::SymbolEntry(SymbolTable *symTab_, TypeEnum type_, DefiEnum defi_,
                          std::string funcName_, std::vector<int> blockVecIndex_,
                          int blockLineIndex_, std::string ident_, std::vector<int> arrayDimVec_,
-                         int initval_, std::vector<int> initvalArray_, bool funcPara_)
+                         int initval_, InitVector initvalArray_, bool funcPara_)
     : symTab(symTab_), type(type_), defi(defi_), ident(ident_), funcName(funcName_),
       blockVecIndex(blockVecIndex_), blockLineIndex(blockLineIndex_), arrayDimVec(arrayDimVec_),
       initval(initval_), initvalArray(initvalArray_), funcPara(funcPara_)
@@ -1,6 +1,7 @@
 #ifndef _SYMTAB_HPP_
 #define _SYMTAB_HPP_
 
+#include "initval.hpp"
 #include "keyword.hpp"
 #include <iostream>
 #include <map>
@@ -28,14 +29,14 @@ class SymbolEntry
     int blockLineIndex;
     std::vector<int> arrayDimVec;
     int initval;
-    std::vector<int> initvalArray;
+    InitVector initvalArray;
     bool funcPara;
 
     SymbolEntry();
     SymbolEntry(SymbolTable *symTab_, TypeEnum type_, DefiEnum defi_, std::string funcName_,
                 std::vector<int> blockVecIndex_, int blockLineIndex_, std::string ident_,
                 std::vector<int> arrayDimVec_, int initval_ = 0,
-                std::vector<int> initvalArray_ = std::vector<int>(), bool funcPara_ = false);
+                InitVector initvalArray_ = InitVector(), bool funcPara_ = false);
     ~SymbolEntry();
     bool isArray() const;
     bool isGlobal() const;